@@ -6,12 +6,44 @@
 
 #include "algorithms/mergesort.h"
 #include "algorithms/quicksort.h"
+#include "algorithms/radixsort.h"
 #include "utils/experiment_parameters.h"
 #include "utils/file_handler.h"
+#include "utils/sort_planner.h"
 #include "utils/sort_verification.h"
 #include "utils/test_generator.h"
 #include "utils/timer.h"
 
+// Returns the arity an engine runs with: the planned one when auto-tuning,
+// which is what autoSort and autoExternalSort choose.
+size_t engineArity(const ExperimentParameters& params, SortEngine engine) {
+  if (!params.useAutoTuning) return params.arity;
+  return planSort(engine, params.dataSize, params.memoryLimit,
+                  CostModel::forMachine())
+      .arity;
+}
+
+// Prints the predicted cost of each engine without generating or sorting
+// the data.
+void explainComparisonExperiment(const ExperimentParameters& params) {
+  size_t N = params.dataSize;
+  size_t M = params.memoryLimit;
+  std::cout << "Explaining " << params.dataType << " data of size " << N
+            << " (M=" << M << ")" << std::endl;
+  std::cout << "  MergeSort: "
+            << MergeSort().explain(
+                   N, M, engineArity(params, SortEngine::MergeSort))
+            << std::endl;
+  std::cout << "  QuickSort: "
+            << QuickSort().explain(
+                   N, M, engineArity(params, SortEngine::QuickSort))
+            << std::endl;
+  std::cout << "  RadixSort: "
+            << RadixSort().explain(
+                   N, M, engineArity(params, SortEngine::RadixSort))
+            << std::endl;
+}
+
 void runComparisonExperiment(const ExperimentParameters& params) {
   std::cout << "Running comparison experiment with " << params.dataType
             << " data of size " << params.dataSize
@@ -46,6 +78,9 @@ void runComparisonExperiment(const ExperimentParameters& params) {
   std::vector<int64_t> mergeData(data.begin(), data.end());
   MergeSort mergeSorter;
   Timer mergeTimer;
+  SortExplanation mergePredicted = mergeSorter.explain(
+      mergeData.size(), params.memoryLimit,
+      engineArity(params, SortEngine::MergeSort));
 
   resetDiskCounters();
 
@@ -59,12 +94,16 @@ void runComparisonExperiment(const ExperimentParameters& params) {
 
   size_t mergeDiskReads = getDiskReadCount();
   size_t mergeDiskWrites = getDiskWriteCount();
+  compareWithCounters(std::cout, mergePredicted);
 
   bool mergeSorted = isSorted<int64_t>(mergeData);
 
   std::vector<int64_t> quickData(data.begin(), data.end());
   QuickSort quickSorter;
   Timer quickTimer;
+  SortExplanation quickPredicted = quickSorter.explain(
+      quickData.size(), params.memoryLimit,
+      engineArity(params, SortEngine::QuickSort));
 
   resetDiskCounters();
 
@@ -78,9 +117,33 @@ void runComparisonExperiment(const ExperimentParameters& params) {
 
   size_t quickDiskReads = getDiskReadCount();
   size_t quickDiskWrites = getDiskWriteCount();
+  compareWithCounters(std::cout, quickPredicted);
 
   bool quickSorted = isSorted<int64_t>(quickData);
 
+  std::vector<int64_t> radixData(data.begin(), data.end());
+  RadixSort radixSorter;
+  Timer radixTimer;
+  SortExplanation radixPredicted = radixSorter.explain(
+      radixData.size(), params.memoryLimit,
+      engineArity(params, SortEngine::RadixSort));
+
+  resetDiskCounters();
+
+  radixTimer.start();
+  if (params.useAutoTuning) {
+    radixSorter.autoSort(radixData, params.memoryLimit);
+  } else {
+    radixSorter.sort(radixData, params.memoryLimit, params.arity);
+  }
+  radixTimer.stop();
+
+  size_t radixDiskReads = getDiskReadCount();
+  size_t radixDiskWrites = getDiskWriteCount();
+  compareWithCounters(std::cout, radixPredicted);
+
+  bool radixSorted = isSorted<int64_t>(radixData);
+
   std::cout << "Results for " << params.dataType << " data of size "
             << params.dataSize << ":" << std::endl;
   std::cout << "  MergeSort time: " << std::fixed << std::setprecision(6)
@@ -95,6 +158,12 @@ void runComparisonExperiment(const ExperimentParameters& params) {
             << std::endl;
   std::cout << "  QuickSort disk reads: " << quickDiskReads << std::endl;
   std::cout << "  QuickSort disk writes: " << quickDiskWrites << std::endl;
+  std::cout << "  RadixSort time: " << std::fixed << std::setprecision(6)
+            << radixTimer.getDuration()
+            << " seconds (sorted: " << (radixSorted ? "Yes" : "No") << ")"
+            << std::endl;
+  std::cout << "  RadixSort disk reads: " << radixDiskReads << std::endl;
+  std::cout << "  RadixSort disk writes: " << radixDiskWrites << std::endl;
   std::cout << "  Speedup: "
             << (mergeTimer.getDuration() / quickTimer.getDuration()) << "x"
             << std::endl;
@@ -109,8 +178,9 @@ void runComparisonExperiment(const ExperimentParameters& params) {
                << mergeDiskReads << "," << mergeDiskWrites << ","
                << quickTimer.getDuration() << "," << quickDiskReads << ","
                << quickDiskWrites << ","
-               << (mergeTimer.getDuration() / quickTimer.getDuration())
-               << std::endl;
+               << (mergeTimer.getDuration() / quickTimer.getDuration()) << ","
+               << radixTimer.getDuration() << "," << radixDiskReads << ","
+               << radixDiskWrites << std::endl;
   }
 }
 
@@ -118,6 +188,9 @@ int main(int argc, char* argv[]) {
   bool runLarge = (argc > 1 && std::string(argv[1]) == "large");
   bool useAutoTuning = true;
 
+  // --explain, as the last argument, prints predictions without sorting.
+  bool explainOnly = argc > 1 && std::string(argv[argc - 1]) == "--explain";
+
   if (argc > 2) {
     std::string tuningParam = argv[2];
     if (tuningParam == "manual") useAutoTuning = false;
@@ -132,7 +205,8 @@ int main(int argc, char* argv[]) {
     resultFile
         << "DataType,Size,MemorySize,MergeSort_Time,MergeSort_DiskReads,"
            "MergeSort_DiskWrites,"
-        << "QuickSort_Time,QuickSort_DiskReads,QuickSort_DiskWrites,Speedup"
+        << "QuickSort_Time,QuickSort_DiskReads,QuickSort_DiskWrites,Speedup,"
+        << "RadixSort_Time,RadixSort_DiskReads,RadixSort_DiskWrites"
         << std::endl;
   }
 
@@ -156,7 +230,11 @@ int main(int argc, char* argv[]) {
         params.memoryLimit = M;
         params.useAutoTuning = useAutoTuning;
 
-        runComparisonExperiment(params);
+        if (explainOnly) {
+          explainComparisonExperiment(params);
+        } else {
+          runComparisonExperiment(params);
+        }
       }
     }
   }
@@ -3,9 +3,21 @@
 #include <string>
 
 #include "utils/dataset_manager.h"
+#include "utils/quantile_sketch.h"
 #include "utils/sort_parameters.h"
 
 int main(int argc, char* argv[]) {
+  // --describe <file> reports the key distribution of an existing dataset.
+  if (argc > 2 && std::string(argv[1]) == "--describe") {
+    try {
+      QuantileSketch::fromFile(argv[2]).printSummary(std::cout);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
   size_t maxMultiplier = 60;
 
   DatasetManager datasetManager;
@@ -2,16 +2,35 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "algorithms/mergesort.h"
 #include "algorithms/quicksort.h"
+#include "algorithms/radixsort.h"
 #include "utils/file_handler.h"
+#include "utils/mapped_file.h"
 #include "utils/sort_parameters.h"
 #include "utils/timer.h"
 
-void runExperiment(const std::string& inputFile, size_t arity) {
+// Prints what each engine is predicted to cost on a sequence file, without
+// loading or sorting it.
+void explainExperiment(const std::string& inputFile, size_t arity) {
+  size_t N = std::filesystem::file_size(inputFile) / sizeof(int64_t);
+  std::cout << "Explaining " << inputFile << " (" << N << " elements, M="
+            << M_SIZE << ", a=" << arity << ")" << std::endl;
+  std::cout << "  MergeSort: " << MergeSort().explain(N, M_SIZE, arity)
+            << std::endl;
+  std::cout << "  QuickSort: " << QuickSort().explain(N, M_SIZE, arity)
+            << std::endl;
+  std::cout << "  RadixSort: " << RadixSort().explain(N, M_SIZE, arity)
+            << std::endl;
+}
+
+// device is the I/O backend of every engine, the default one if null.
+void runExperiment(const std::string& inputFile, size_t arity,
+                   const std::shared_ptr<BlockDevice>& device) {
   std::cout << "Running experiment on " << inputFile << std::endl;
 
   std::string filename = std::filesystem::path(inputFile).filename().string();
@@ -20,10 +39,15 @@ void runExperiment(const std::string& inputFile, size_t arity) {
   std::string sizeStr = filename.substr(pos1, pos2 - pos1);
   size_t multiplier = std::stoul(sizeStr);
 
-  std::vector<int64_t> data = readInt64DataFromFile(inputFile);
+  // The dataset is mapped, not read: every engine consumes it in place and
+  // sorts into the same output buffer, so the input is neither copied up
+  // front nor duplicated per engine.
+  MappedFile data(inputFile, AccessPattern::Sequential);
+  std::vector<int64_t> sortedData(data.size());
 
   std::string mergeResultsFile = "data/results/mergesort_results.csv";
   std::string quickResultsFile = "data/results/quicksort_results.csv";
+  std::string radixResultsFile = "data/results/radixsort_results.csv";
 
   if (!std::filesystem::exists(mergeResultsFile)) {
     std::ofstream file(mergeResultsFile);
@@ -37,27 +61,36 @@ void runExperiment(const std::string& inputFile, size_t arity) {
          << std::endl;
   }
 
+  if (!std::filesystem::exists(radixResultsFile)) {
+    std::ofstream file(radixResultsFile);
+    file << "Multiplier,Size,Time,DiskReads,DiskWrites,Sequence,Sorted"
+         << std::endl;
+  }
+
   pos1 = filename.find("M_") + 2;
   pos2 = filename.find(".bin");
   std::string seqStr = filename.substr(pos1, pos2 - pos1);
   size_t sequence = std::stoul(seqStr);
 
   {
-    std::vector<int64_t> testData = data;
-
+    // Read ahead before the timer starts, as the copy used to be.
+    data.willNeed(0, data.size());
     resetDiskCounters();
 
     MergeSort sorter;
+    sorter.setBlockDevice(device);
     Timer timer;
+    SortExplanation predicted = sorter.explain(data.size(), M_SIZE, arity);
 
     std::cout << "  Running MergeSort with arity " << arity << std::endl;
     timer.start();
-    sorter.externalSort(testData, M_SIZE, arity);
+    sorter.sortView(data.data(), data.size(), sortedData.data(), M_SIZE,
+                    arity);
     timer.stop();
 
     bool sorted = true;
-    for (size_t i = 1; i < testData.size(); i++) {
-      if (testData[i] < testData[i - 1]) {
+    for (size_t i = 1; i < sortedData.size(); i++) {
+      if (sortedData[i] < sortedData[i - 1]) {
         sorted = false;
         break;
       }
@@ -72,24 +105,29 @@ void runExperiment(const std::string& inputFile, size_t arity) {
               << " seconds" << std::endl;
     std::cout << "  Disk reads: " << getDiskReadCount()
               << ", writes: " << getDiskWriteCount() << std::endl;
+    std::cout << "  I/O: " << sorter.ioStats() << std::endl;
+    compareWithCounters(std::cout, predicted);
   }
 
   {
-    std::vector<int64_t> testData = data;
-
+    // Read ahead before the timer starts, as the copy used to be.
+    data.willNeed(0, data.size());
     resetDiskCounters();
 
     QuickSort sorter;
+    sorter.setBlockDevice(device);
     Timer timer;
+    SortExplanation predicted = sorter.explain(data.size(), M_SIZE, arity);
 
     std::cout << "  Running QuickSort with arity " << arity << std::endl;
     timer.start();
-    sorter.sort(testData, M_SIZE, arity);
+    sorter.sortView(data.data(), data.size(), sortedData.data(), M_SIZE,
+                    arity);
     timer.stop();
 
     bool sorted = true;
-    for (size_t i = 1; i < testData.size(); i++) {
-      if (testData[i] < testData[i - 1]) {
+    for (size_t i = 1; i < sortedData.size(); i++) {
+      if (sortedData[i] < sortedData[i - 1]) {
         sorted = false;
         break;
       }
@@ -104,6 +142,45 @@ void runExperiment(const std::string& inputFile, size_t arity) {
               << " seconds" << std::endl;
     std::cout << "  Disk reads: " << getDiskReadCount()
               << ", writes: " << getDiskWriteCount() << std::endl;
+    std::cout << "  I/O: " << sorter.ioStats() << std::endl;
+    compareWithCounters(std::cout, predicted);
+  }
+
+  {
+    // Read ahead before the timer starts, as the copy used to be.
+    data.willNeed(0, data.size());
+    resetDiskCounters();
+
+    RadixSort sorter;
+    sorter.setBlockDevice(device);
+    Timer timer;
+    SortExplanation predicted = sorter.explain(data.size(), M_SIZE, arity);
+
+    std::cout << "  Running RadixSort with arity " << arity << std::endl;
+    timer.start();
+    sorter.sortView(data.data(), data.size(), sortedData.data(), M_SIZE,
+                    arity);
+    timer.stop();
+
+    bool sorted = true;
+    for (size_t i = 1; i < sortedData.size(); i++) {
+      if (sortedData[i] < sortedData[i - 1]) {
+        sorted = false;
+        break;
+      }
+    }
+
+    std::ofstream file(radixResultsFile, std::ios::app);
+    file << multiplier << "," << data.size() << "," << timer.getDuration()
+         << "," << getDiskReadCount() << "," << getDiskWriteCount() << ","
+         << sequence << "," << (sorted ? "1" : "0") << std::endl;
+
+    std::cout << "  RadixSort completed in " << timer.getDuration()
+              << " seconds" << std::endl;
+    std::cout << "  Disk reads: " << getDiskReadCount()
+              << ", writes: " << getDiskWriteCount() << std::endl;
+    std::cout << "  I/O: " << sorter.ioStats() << std::endl;
+    compareWithCounters(std::cout, predicted);
   }
 }
 
@@ -143,8 +220,22 @@ int main(int argc, char* argv[]) {
 
   std::sort(seqFiles.begin(), seqFiles.end());
 
-  if (argc > 1) {
-    std::string sizeArg = argv[1];
+  // --explain prints the predicted cost of every run without sorting;
+  // --direct sorts with O_DIRECT files that bypass the page cache.
+  bool explainOnly = false;
+  std::shared_ptr<BlockDevice> device;
+  std::string sizeArg;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--explain") {
+      explainOnly = true;
+    } else if (std::string(argv[i]) == "--direct") {
+      device = std::make_shared<DirectBlockDevice>();
+    } else {
+      sizeArg = argv[i];
+    }
+  }
+
+  if (!sizeArg.empty()) {
     size_t targetSize = std::stoul(sizeArg);
 
     std::vector<std::string> filteredFiles;
@@ -162,7 +253,11 @@ int main(int argc, char* argv[]) {
   }
 
   for (const auto& file : seqFiles) {
-    runExperiment(file, arity);
+    if (explainOnly) {
+      explainExperiment(file, arity);
+    } else {
+      runExperiment(file, arity, device);
+    }
   }
 
   std::cout << "All experiments completed!" << std::endl;
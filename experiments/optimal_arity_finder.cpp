@@ -1,9 +1,14 @@
+#include <unistd.h>
+
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
-#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -11,147 +16,249 @@
 #include "utils/file_handler.h"
 #include "utils/file_manager.h"
 #include "utils/sort_parameters.h"
+#include "utils/sort_planner.h"
 #include "utils/sort_verification.h"
+#include "utils/thread_pool.h"
 #include "utils/timer.h"
 
-double testMergeSortArity(const std::vector<int64_t>& data, size_t M,
-                          size_t a) {
-  std::cout << "Testing arity: " << a << std::endl;
-
-  size_t elementSize = sizeof(int64_t);
-  size_t totalBuffers = a + 1;
-  size_t bufferSize = (M * 0.9) / (totalBuffers * elementSize);
-
-  if (bufferSize < 1000) {
-    std::cout << "  Buffer size too small (" << bufferSize
-              << " elements), skipping" << std::endl;
-    return std::numeric_limits<double>::max();
+// Options of the measured search.
+struct SearchOptions {
+  size_t elements = 4000000;  // Keys sorted per trial
+  size_t minTrials = 3;       // Trials per arity before comparing
+  size_t maxTrials = 7;       // Trials per arity when intervals overlap
+  size_t jobs = 1;            // Trials run concurrently
+  bool dropCache = false;     // Drop the page cache before every batch
+};
+
+// Wall times of the trials of one arity.
+struct TrialStats {
+  std::vector<double> times;
+
+  double mean() const {
+    double sum = 0;
+    for (double t : times) sum += t;
+    return times.empty() ? 0 : sum / times.size();
   }
 
-  size_t testSize = std::min(data.size(), size_t(10000000));
-  std::vector<int64_t> testData(data.begin(), data.begin() + testSize);
-
-  std::cout << "  Running test with " << testSize << " elements" << std::endl;
-  std::cout << "  Buffer size: " << bufferSize << " elements" << std::endl;
-
-  resetDiskCounters();
-
-  MergeSort sorter;
-  Timer timer;
-
-  timer.start();
-  sorter.externalSort(testData, M, a);
-  timer.stop();
-
-  double duration = timer.getDuration();
-  std::cout << "  Time: " << duration << " seconds" << std::endl;
-  std::cout << "  Disk reads: " << getDiskReadCount()
-            << ", writes: " << getDiskWriteCount() << std::endl;
-
-  if (!isSorted<int64_t>(testData)) {
-    std::cerr << "  Error: Result is not sorted for arity " << a << std::endl;
-    return std::numeric_limits<double>::max();
+  // Half width of the 95% confidence interval of the mean (Student t).
+  double halfWidth() const {
+    static const double T975[] = {12.706, 4.303, 3.182, 2.776, 2.571,
+                                  2.447,  2.365, 2.306, 2.262};
+    size_t n = times.size();
+    if (n < 2) return std::numeric_limits<double>::infinity();
+
+    double m = mean();
+    double variance = 0;
+    for (double t : times) variance += (t - m) * (t - m);
+    variance /= n - 1;
+    double t = n - 1 <= 9 ? T975[n - 2] : 1.96;
+    return t * std::sqrt(variance / n);
+  }
+};
+
+// Writes dirty pages and asks the kernel to drop the page cache, so every
+// trial starts cold. Needs root; otherwise it only syncs.
+void dropPageCache() {
+  sync();
+  std::ofstream control("/proc/sys/vm/drop_caches");
+  control << "3" << std::endl;
+  static bool warned = false;
+  if (!control && !warned) {
+    std::cerr << "Cannot drop the page cache (not root?), only syncing"
+              << std::endl;
+    warned = true;
   }
-
-  return duration;
 }
 
-size_t smartBinarySearch(
-    const std::vector<int64_t>& data,
-    std::function<double(const std::vector<int64_t>&, size_t, size_t)>
-        testWithArity) {
-  size_t minArity = 2;
-  size_t maxArity = 512;
+class AritySearch {
+ public:
+  AritySearch(const std::vector<int64_t>& data, size_t M,
+              const SearchOptions& options)
+      : data(data), M(M), options(options), pool(options.jobs) {}
+
+  // Runs trials of arity a until it has at least count of them.
+  const TrialStats& measure(size_t a, size_t count) {
+    TrialStats& stats = results[a];
+    while (stats.times.size() < count) {
+      if (options.dropCache) dropPageCache();
+
+      size_t batch = std::min(options.jobs, count - stats.times.size());
+      std::vector<double> times(batch);
+      std::vector<std::future<void>> done;
+      for (size_t job = 0; job < batch; job++) {
+        done.push_back(pool.submit([this, a, job, &times] {
+          times[job] = trial(a, job);
+        }));
+      }
+      for (auto& future : done) future.get();
+      stats.times.insert(stats.times.end(), times.begin(), times.end());
+    }
+    return stats;
+  }
 
-  std::cout << "Starting smart binary search for optimal arity in range ["
-            << minArity << ", " << maxArity << "]" << std::endl;
+  // True if arity a is faster than arity b. Overlapping confidence
+  // intervals get more trials before the means decide.
+  bool faster(size_t a, size_t b) {
+    size_t trials = options.minTrials;
+    while (true) {
+      const TrialStats& sa = measure(a, trials);
+      const TrialStats& sb = measure(b, trials);
+      bool separated = std::abs(sa.mean() - sb.mean()) >
+                       sa.halfWidth() + sb.halfWidth();
+      if (separated || trials >= options.maxTrials) {
+        return sa.mean() < sb.mean();
+      }
+      trials++;
+    }
+  }
 
-  const std::vector<size_t> landmarks = {2, 4, 8, 16, 32, 64, 128, 256, 512};
-  std::vector<std::pair<size_t, double>> results;
+  // Golden-section search for the fastest arity in [low, high], assuming
+  // a unimodal cost curve.
+  size_t search(size_t low, size_t high) {
+    const double invPhi = (std::sqrt(5.0) - 1) / 2;
+    auto lower = [&](size_t lo, size_t hi) {
+      return hi - static_cast<size_t>(std::lround(invPhi * (hi - lo)));
+    };
+    auto upper = [&](size_t lo, size_t hi) {
+      return lo + static_cast<size_t>(std::lround(invPhi * (hi - lo)));
+    };
+
+    while (high - low > 2) {
+      size_t c = lower(low, high);
+      size_t d = upper(low, high);
+      if (c >= d) break;
+      if (faster(c, d)) {
+        high = d;
+      } else {
+        low = c;
+      }
+    }
 
-  std::cout << "Phase 1: Testing landmark arity values" << std::endl;
-  for (size_t a : landmarks) {
-    double time = testWithArity(data, M_SIZE, a);
-    if (time < std::numeric_limits<double>::max()) {
-      results.push_back({a, time});
-      std::cout << "  Arity " << a << ": " << time << " seconds" << std::endl;
+    size_t best = low;
+    for (size_t a = low + 1; a <= high; a++) {
+      if (faster(a, best)) best = a;
     }
+    return best;
   }
 
-  if (results.empty()) {
-    std::cerr
-        << "No valid arity values found in landmarks! Using default arity=8"
-        << std::endl;
-    return 8;
+  void printSummary() const {
+    std::cout << "Measured arities (mean +/- 95% CI over trials):"
+              << std::endl;
+    for (const auto& [a, stats] : results) {
+      std::cout << "  Arity " << a << ": " << stats.mean() << " +/- "
+                << stats.halfWidth() << " s (" << stats.times.size()
+                << " trials)" << std::endl;
+    }
   }
 
-  auto bestLandmark = std::min_element(
-      results.begin(), results.end(),
-      [](const auto& a, const auto& b) { return a.second < b.second; });
+ private:
+  double trial(size_t a, size_t job) {
+    std::vector<int64_t> copy(data);
+    MergeSort sorter;
+    sorter.setTempDirectory("data/arity_trials/job_" + std::to_string(job));
 
-  std::cout << "Best landmark arity: " << bestLandmark->first << " with time "
-            << bestLandmark->second << " seconds" << std::endl;
+    Timer timer;
+    timer.start();
+    sorter.externalSort(copy, M, a);
+    timer.stop();
 
-  size_t bestArity = bestLandmark->first;
-  double bestTime = bestLandmark->second;
+    if (!isSorted<int64_t>(copy)) {
+      throw std::runtime_error("Result is not sorted for arity " +
+                               std::to_string(a));
+    }
+    return timer.getDuration();
+  }
 
-  size_t lowerBound = bestArity / 2;
-  if (lowerBound < 2) lowerBound = 2;
+  const std::vector<int64_t>& data;
+  size_t M;
+  SearchOptions options;
+  ThreadPool pool;
+  std::map<size_t, TrialStats> results;
+};
+
+// Measures the best MergeSort arity for the full test file on a sample of
+// it. The memory limit is scaled with the sample, so the sample forms as
+// many runs as the full file and goes through the same merge tree.
+size_t measureOptimalArity(const std::string& testFile,
+                           const SearchOptions& options) {
+  size_t fullElements =
+      std::filesystem::file_size(testFile) / sizeof(int64_t);
+  size_t elements = std::min(options.elements, fullElements);
+
+  std::vector<int64_t> sample(elements);
+  std::ifstream in(testFile, std::ios::binary);
+  in.read(reinterpret_cast<char*>(sample.data()),
+          elements * sizeof(int64_t));
+  if (!in) {
+    throw std::runtime_error("Could not read test file: " + testFile);
+  }
 
-  size_t upperBound = bestArity * 2;
-  if (upperBound > 512) upperBound = 512;
+  // externalSort forms runs of mergeRunElements(M) elements; the sample
+  // gets an M that splits it into as many runs as the full file.
+  size_t fullRun = mergeRunElements(M_SIZE);
+  size_t runs = std::max(size_t(1), (fullElements + fullRun - 1) / fullRun);
+  size_t M = 2 * sizeof(int64_t) * std::max(size_t(1),
+                                            (elements + runs - 1) / runs);
+
+  std::cout << "Measuring on " << elements << " of " << fullElements
+            << " elements with M=" << M << " (" << runs << " runs, as with"
+            << " M=" << M_SIZE << " on the full file), " << options.jobs
+            << " concurrent trials" << std::endl;
+
+  // Arities beyond the run count all merge in a single pass.
+  size_t highest = std::max(size_t(2), runs);
+  AritySearch search(sample, M, options);
+  size_t best = search.search(2, highest);
+  search.printSummary();
+
+  std::filesystem::remove_all("data/arity_trials");
+  return best;
+}
 
-  if (upperBound - lowerBound <= 10) {
-    std::cout << "Phase 2: Linear search in range [" << lowerBound << ", "
-              << upperBound << "]" << std::endl;
-    for (size_t a = lowerBound; a <= upperBound; a++) {
-      if (std::find_if(results.begin(), results.end(), [a](const auto& p) {
-            return p.first == a;
-          }) != results.end()) {
-        continue;
-      }
+// Predicts the best arity from the calibrated cost model instead of sorting.
+size_t predictOptimalArity(size_t N) {
+  CostModel model = CostModel::forMachine();
+  std::cout << "Cost model: " << model << std::endl;
 
-      double time = testWithArity(data, M_SIZE, a);
-      if (time < bestTime) {
-        bestTime = time;
-        bestArity = a;
-        std::cout << "  New best arity: " << bestArity << " with time "
-                  << bestTime << " seconds" << std::endl;
-      }
-    }
-  } else {
-    std::cout << "Phase 2: Strategic refinement around arity " << bestArity
+  const std::vector<size_t> landmarks = {2, 4, 8, 16, 32, 64, 128, 256, 512};
+  for (size_t a : landmarks) {
+    std::cout << "  Arity " << a << ": "
+              << evaluatePlan(SortEngine::MergeSort, N, M_SIZE, a, model)
               << std::endl;
-    std::vector<size_t> refinementPoints;
-
-    if (bestArity > 2) refinementPoints.push_back(bestArity - bestArity / 4);
-    refinementPoints.push_back(bestArity + bestArity / 4);
+  }
 
-    for (size_t a : refinementPoints) {
-      if (a < 2 || a > 512) continue;
+  SortPlan mergePlan = planSort(SortEngine::MergeSort, N, M_SIZE, model);
+  SortPlan quickPlan = planSort(SortEngine::QuickSort, N, M_SIZE, model);
+  SortPlan radixPlan = planSort(SortEngine::RadixSort, N, M_SIZE, model);
+  std::cout << "MergeSort plan: " << mergePlan << std::endl;
+  std::cout << "QuickSort plan: " << quickPlan << std::endl;
+  std::cout << "RadixSort plan: " << radixPlan << std::endl;
 
-      if (std::find_if(results.begin(), results.end(), [a](const auto& p) {
-            return p.first == a;
-          }) != results.end()) {
-        continue;
-      }
+  return mergePlan.arity;
+}
 
-      double time = testWithArity(data, M_SIZE, a);
-      if (time < bestTime) {
-        bestTime = time;
-        bestArity = a;
-        std::cout << "  New best arity: " << bestArity << " with time "
-                  << bestTime << " seconds" << std::endl;
-      }
+int main(int argc, char* argv[]) {
+  // By default the cost model predicts the arity. --measure searches it by
+  // sorting a sample of the test file instead; --trials, --jobs, --elements
+  // and --drop-cache tune the measurement.
+  bool measure = false;
+  SearchOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--measure") {
+      measure = true;
+    } else if (arg == "--drop-cache") {
+      options.dropCache = true;
+    } else if (arg == "--trials" && i + 1 < argc) {
+      options.minTrials = std::max<size_t>(2, std::stoul(argv[++i]));
+      options.maxTrials = std::max(options.maxTrials, options.minTrials);
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      options.jobs = std::max<size_t>(1, std::stoul(argv[++i]));
+    } else if (arg == "--elements" && i + 1 < argc) {
+      options.elements = std::max<size_t>(1, std::stoul(argv[++i]));
     }
   }
 
-  std::cout << "Final optimal arity determined: " << bestArity << " with time "
-            << bestTime << " seconds" << std::endl;
-  return bestArity;
-}
-
-int main() {
   FileManager& fileManager = FileManager::getInstance();
 
   std::string testFile = fileManager.findLargestArityTestFile();
@@ -162,22 +269,33 @@ int main() {
               << testFile << std::endl;
   }
 
-  std::cout << "Loading test data from " << testFile << std::endl;
+  if (!measure) {
+    size_t N = 60 * M_SIZE / sizeof(int64_t);
+    if (std::filesystem::exists(testFile)) {
+      N = std::filesystem::file_size(testFile) / sizeof(int64_t);
+    }
+    std::cout << "Predicting optimal arity for " << N << " elements"
+              << std::endl;
+
+    size_t optimalArity = predictOptimalArity(N);
+
+    std::ofstream arityFile("data/optimal_arity.txt");
+    arityFile << optimalArity << std::endl;
+
+    std::cout << "Optimal arity: " << optimalArity << std::endl;
+    return 0;
+  }
 
-  std::vector<int64_t> testData;
+  size_t optimalArity = 0;
   try {
-    testData = readInt64DataFromFile(testFile);
+    optimalArity = measureOptimalArity(testFile, options);
   } catch (const std::exception& e) {
-    std::cerr << "Error loading test data: " << e.what() << std::endl;
+    std::cerr << "Error measuring arity: " << e.what() << std::endl;
     std::cerr << "Please run data_generator first to create the test data."
               << std::endl;
     return 1;
   }
 
-  std::cout << "Loaded " << testData.size() << " elements." << std::endl;
-
-  size_t optimalArity = smartBinarySearch(testData, testMergeSortArity);
-
   std::ofstream arityFile("data/optimal_arity.txt");
   arityFile << optimalArity << std::endl;
   arityFile.close();
@@ -20,6 +20,9 @@ required_files = [
     'data/results/quicksort_results.csv',
 ]
 
+# RadixSort results are plotted when present
+radix_results_file = 'data/results/radixsort_results.csv'
+
 for file in required_files:
     if not os.path.exists(file):
         print(f"Warning: {file} not found. Some visualizations may be incomplete.")
@@ -63,6 +66,11 @@ def create_time_comparison_graph():
                  'b-o', label='MergeSort')
         plt.plot(quick_results['Multiplier'], quick_results['Time'], 
                  'r-o', label='QuickSort')
+        if os.path.exists(radix_results_file):
+            radix_results = process_algorithm_results(radix_results_file)
+            if radix_results is not None:
+                plt.plot(radix_results['Multiplier'], radix_results['Time'],
+                         'g-o', label='RadixSort')
         
         plt.title('Average Execution Time vs Array Size')
         plt.xlabel('Array Size (multiples of M, where M=50MB)')
@@ -99,6 +107,12 @@ def create_disk_operations_graph():
                 'b-o', label='MergeSort')
         plt.plot(quick_results['Multiplier'], quick_results['TotalDiskOps'], 
                 'r-o', label='QuickSort')
+        if os.path.exists(radix_results_file):
+            radix_results = process_algorithm_results(radix_results_file)
+            if radix_results is not None:
+                radix_results['TotalDiskOps'] = radix_results['DiskReads'] + radix_results['DiskWrites']
+                plt.plot(radix_results['Multiplier'], radix_results['TotalDiskOps'],
+                         'g-o', label='RadixSort')
         
         # Add this line to set logarithmic scale
         plt.yscale('log')
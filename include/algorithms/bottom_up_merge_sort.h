@@ -0,0 +1,89 @@
+#ifndef BOTTOM_UP_MERGE_SORT_H
+#define BOTTOM_UP_MERGE_SORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Width of the blocks that bottomUpMergeSort sorts by insertion
+ * before the first merge pass.
+ */
+constexpr size_t MERGE_SORT_BLOCK_SIZE = 16;
+
+/**
+ * @brief Sorts a small range in place with insertion sort.
+ * @param data The range to sort.
+ * @param n The number of elements.
+ */
+template <typename T>
+void insertionSort(T* data, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    T value = data[i];
+    size_t j = i;
+    while (j > 0 && value < data[j - 1]) {
+      data[j] = data[j - 1];
+      j--;
+    }
+    data[j] = value;
+  }
+}
+
+/**
+ * @brief Merges the sorted ranges [left, mid) and [mid, right) of src into
+ * the same positions of dst. Equal keys keep their order.
+ */
+template <typename T>
+void mergeAdjacent(const T* src, T* dst, size_t left, size_t mid,
+                   size_t right) {
+  if (mid == right || !(src[mid] < src[mid - 1])) {
+    std::copy(src + left, src + right, dst + left);
+    return;
+  }
+
+  size_t i = left;
+  size_t j = mid;
+  size_t k = left;
+  while (i < mid && j < right) {
+    dst[k++] = src[j] < src[i] ? src[j++] : src[i++];
+  }
+  std::copy(src + i, src + mid, dst + k);
+  std::copy(src + j, src + right, dst + k + (mid - i));
+}
+
+/**
+ * @brief Stable bottom-up merge sort that never allocates.
+ *
+ * Blocks of MERGE_SORT_BLOCK_SIZE elements are insertion sorted in place,
+ * then each pass doubles the run width, ping-ponging between data and
+ * buffer. Adjacent runs that are already in order are copied without
+ * comparisons. The result is copied back into data after an odd number of
+ * passes.
+ *
+ * @param data The elements to sort.
+ * @param n The number of elements.
+ * @param buffer A buffer of at least n elements.
+ */
+template <typename T>
+void bottomUpMergeSort(T* data, size_t n, T* buffer) {
+  for (size_t start = 0; start < n; start += MERGE_SORT_BLOCK_SIZE) {
+    insertionSort(data + start, std::min(MERGE_SORT_BLOCK_SIZE, n - start));
+  }
+
+  T* src = data;
+  T* dst = buffer;
+  for (size_t width = MERGE_SORT_BLOCK_SIZE; width < n; width *= 2) {
+    for (size_t left = 0; left < n; left += 2 * width) {
+      size_t mid = std::min(left + width, n);
+      size_t right = std::min(left + 2 * width, n);
+      mergeAdjacent(src, dst, left, mid, right);
+    }
+    std::swap(src, dst);
+  }
+
+  if (src != data) {
+    std::copy(src, src + n, data);
+  }
+}
+
+#endif  // BOTTOM_UP_MERGE_SORT_H
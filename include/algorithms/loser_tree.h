@@ -0,0 +1,161 @@
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Tournament (loser) tree used as the k-way merge kernel.
+ *
+ * Each leaf is a source with a current key. Internal nodes store the loser
+ * of the match played there, so replacing the winner only replays the path
+ * from its leaf to the root: one comparison per level and no node copies.
+ * Exhausted sources lose every match.
+ *
+ * @tparam T The key type.
+ * @tparam Compare Strict weak ordering used to pick the winner.
+ */
+template <typename T, typename Compare = std::less<T>>
+class LoserTree {
+ public:
+  /**
+   * @brief Creates a tree for k sources, all of them initially exhausted.
+   * @param k The number of sources.
+   * @param comp The comparator.
+   */
+  explicit LoserTree(size_t k, Compare comp = Compare())
+      : k(k),
+        keys(k),
+        active(k, 0),
+        tree(k > 0 ? k : 1, 0),
+        comp(comp) {}
+
+  /**
+   * @brief Sets the current key of a source before build().
+   * @param i The source index.
+   * @param key The first key of the source.
+   */
+  void setLeaf(size_t i, const T& key) {
+    keys[i] = key;
+    active[i] = 1;
+  }
+
+  /**
+   * @brief Plays the initial tournament over all leaves.
+   */
+  void build() {
+    if (k == 0) return;
+
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; i++) {
+      winners[k + i] = i;
+    }
+    for (size_t node = k - 1; node > 0; node--) {
+      size_t left = winners[2 * node];
+      size_t right = winners[2 * node + 1];
+      if (beats(left, right)) {
+        winners[node] = left;
+        tree[node] = right;
+      } else {
+        winners[node] = right;
+        tree[node] = left;
+      }
+    }
+    tree[0] = k == 1 ? 0 : winners[1];
+  }
+
+  /**
+   * @brief Returns true once every source is exhausted.
+   */
+  bool empty() const { return k == 0 || !active[tree[0]]; }
+
+  /**
+   * @brief Returns the index of the source holding the smallest key.
+   */
+  size_t winner() const { return tree[0]; }
+
+  /**
+   * @brief Returns the smallest key among all sources.
+   */
+  const T& winnerKey() const { return keys[tree[0]]; }
+
+  /**
+   * @brief Replaces the winner's key with the next key of the same source.
+   * @param key The next key of the winning source.
+   */
+  void replaceWinner(const T& key) {
+    size_t leaf = tree[0];
+    keys[leaf] = key;
+    replay(leaf);
+  }
+
+  /**
+   * @brief Marks the winning source as exhausted.
+   */
+  void removeWinner() {
+    size_t leaf = tree[0];
+    active[leaf] = 0;
+    replay(leaf);
+  }
+
+ private:
+  bool beats(size_t a, size_t b) const {
+    return active[a] && (!active[b] || comp(keys[a], keys[b]));
+  }
+
+  void replay(size_t leaf) {
+    size_t winner = leaf;
+    for (size_t node = (k + leaf) / 2; node > 0; node /= 2) {
+      if (beats(tree[node], winner)) {
+        std::swap(tree[node], winner);
+      }
+    }
+    tree[0] = winner;
+  }
+
+  size_t k;
+  std::vector<T> keys;
+  std::vector<uint8_t> active;
+  std::vector<size_t> tree;
+  Compare comp;
+};
+
+/**
+ * @brief Merges sorted in-memory ranges into out with a loser tree.
+ * @param runs The [begin, end) pointers of each sorted range.
+ * @param out The destination, large enough for every element of runs.
+ * @param comp The comparator.
+ * @return Pointer one past the last element written.
+ */
+template <typename T, typename Compare = std::less<T>>
+T* multiwayMerge(const std::vector<std::pair<const T*, const T*>>& runs,
+                 T* out, Compare comp = Compare()) {
+  std::vector<const T*> positions(runs.size());
+  LoserTree<T, Compare> tree(runs.size(), comp);
+
+  for (size_t i = 0; i < runs.size(); i++) {
+    positions[i] = runs[i].first;
+    if (positions[i] != runs[i].second) {
+      tree.setLeaf(i, *positions[i]);
+    }
+  }
+  tree.build();
+
+  while (!tree.empty()) {
+    size_t source = tree.winner();
+    *out++ = tree.winnerKey();
+
+    if (++positions[source] != runs[source].second) {
+      tree.replaceWinner(*positions[source]);
+    } else {
+      tree.removeWinner();
+    }
+  }
+
+  return out;
+}
+
+#endif  // LOSER_TREE_H
@@ -0,0 +1,112 @@
+#ifndef LSD_RADIX_SORT_H
+#define LSD_RADIX_SORT_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Minimum number of elements for which sortKeys uses the radix
+ * kernel; below it std::sort is faster.
+ */
+constexpr size_t RADIX_SORT_THRESHOLD = 4096;
+
+/**
+ * @brief Sorts integral keys with an LSD radix sort on 8-bit digits.
+ *
+ * The sign bit is flipped so that signed keys order correctly as unsigned.
+ * All digit histograms are built in a single pass, and digits that are equal
+ * across the whole input are skipped, so e.g. keys below 2^40 take five
+ * scatter passes instead of eight.
+ *
+ * @tparam T An integral key type.
+ * @param data The keys to sort.
+ * @param n The number of keys.
+ * @param scratch A buffer of at least n elements, used as ping-pong target.
+ */
+template <typename T>
+void lsdRadixSort(T* data, size_t n, T* scratch) {
+  static_assert(std::is_integral<T>::value,
+                "lsdRadixSort requires integral keys");
+  using U = typename std::make_unsigned<T>::type;
+  constexpr size_t DIGITS = sizeof(T);
+  constexpr U SIGN_FLIP =
+      std::is_signed<T>::value ? U(U(1) << (8 * sizeof(T) - 1)) : U(0);
+
+  if (n < 2) return;
+
+  std::array<std::array<size_t, 256>, DIGITS> counts{};
+  for (size_t i = 0; i < n; i++) {
+    U key = static_cast<U>(data[i]) ^ SIGN_FLIP;
+    for (size_t d = 0; d < DIGITS; d++) {
+      counts[d][(key >> (8 * d)) & 0xFF]++;
+    }
+  }
+
+  T* src = data;
+  T* dst = scratch;
+  U firstKey = static_cast<U>(data[0]) ^ SIGN_FLIP;
+
+  for (size_t d = 0; d < DIGITS; d++) {
+    if (counts[d][(firstKey >> (8 * d)) & 0xFF] == n) {
+      continue;
+    }
+
+    std::array<size_t, 256> offsets;
+    size_t sum = 0;
+    for (size_t b = 0; b < 256; b++) {
+      offsets[b] = sum;
+      sum += counts[d][b];
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      U key = static_cast<U>(src[i]) ^ SIGN_FLIP;
+      dst[offsets[(key >> (8 * d)) & 0xFF]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+
+  if (src != data) {
+    std::copy(src, src + n, data);
+  }
+}
+
+/**
+ * @brief Sorts keys in memory, using the radix kernel for integral keys of
+ * at least RADIX_SORT_THRESHOLD elements and std::sort otherwise.
+ * @param data The keys to sort.
+ * @param n The number of keys.
+ * @param scratch A buffer of at least n elements.
+ */
+template <typename T>
+void sortKeys(T* data, size_t n, T* scratch) {
+  if constexpr (std::is_integral<T>::value) {
+    if (n >= RADIX_SORT_THRESHOLD) {
+      lsdRadixSort(data, n, scratch);
+      return;
+    }
+  }
+  std::sort(data, data + n);
+}
+
+/**
+ * @brief Same as above with a reusable scratch vector, grown to n elements
+ * only when the radix kernel is used; callers must budget for it.
+ * @param data The keys to sort.
+ * @param n The number of keys.
+ * @param scratch The reusable scratch buffer.
+ */
+template <typename T, typename Allocator>
+void sortKeys(T* data, size_t n, std::vector<T, Allocator>& scratch) {
+  if (std::is_integral<T>::value && n >= RADIX_SORT_THRESHOLD &&
+      scratch.size() < n) {
+    scratch.resize(n);
+  }
+  sortKeys(data, n, scratch.data());
+}
+
+#endif  // LSD_RADIX_SORT_H
@@ -2,9 +2,40 @@
 #define MERGESORT_H
 
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
+#include "utils/aligned_buffer_pool.h"
+#include "utils/io_context.h"
+#include "utils/sort_planner.h"
+
+class ThreadPool;
+
+/**
+ * @brief One merge of a multi-pass merge plan.
+ *
+ * Inputs index the initial runs first; the result of step i gets index
+ * K + i, where K is the number of initial runs.
+ */
+struct MergeStep {
+  std::vector<size_t> inputs;
+  size_t output;
+  size_t elements;
+  size_t level;
+};
+
+/**
+ * @brief Strategy used to cut the input into initial sorted runs.
+ *
+ * FixedSize sorts consecutive slices of the run budget. ReplacementSelection
+ * streams the input through a heap of the same budget, producing runs of
+ * about twice that size on random input and a single run on sorted input.
+ */
+enum class RunGeneration { FixedSize, ReplacementSelection };
+
 /**
  * @brief MergeSort class provides methods for sorting arrays using the merge
  * sort algorithm.
@@ -12,11 +43,25 @@
 class MergeSort {
  public:
   /**
-   * @brief Sorts an array of integers using the merge sort algorithm.
+   * @brief Receives consecutive blocks of sorted output. Blocks are
+   * delivered in order from the background I/O thread of the final merge
+   * and are only valid during the call.
+   */
+  using MergeSink = std::function<void(const int64_t*, size_t)>;
+
+  /**
+   * @brief Sorts an array of integers in memory with a bottom-up merge sort
+   * that allocates a single buffer of arr.size() elements.
    * @param arr The array to be sorted.
    */
   void sort(std::vector<int>& arr);
 
+  /**
+   * @brief Same as above for 64-bit integers.
+   * @param arr The array to be sorted.
+   */
+  void sort(std::vector<int64_t>& arr);
+
   /**
    * @brief Sorts an array of integers using the external merge sort algorithm.
    * @param arr The array to be sorted.
@@ -26,60 +71,345 @@ class MergeSort {
   void externalSort(std::vector<int64_t>& arr, size_t M, size_t a);
 
   /**
-   * @brief Sorts an array of integers using the auto external merge sort
-   * algorithm.
+   * @brief Sorts n integers into output with external merge sort, reading
+   * them in place from input, such as the data() of a MappedFile, without
+   * copying the whole input first. Costs what explain(n, M, a) predicts.
+   * If the external sort fails, the input is sorted in memory instead,
+   * unless an in-place merge has already overwritten part of it; then the
+   * error is rethrown.
+   * @param input The integers to sort.
+   * @param n The number of integers.
+   * @param output Room for n integers; it may be input itself.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  void sortView(const int64_t* input, size_t n, int64_t* output, size_t M,
+                size_t a);
+
+  /**
+   * @brief Sorts an array of integers with external merge sort, using the
+   * arity planSort predicts to be fastest on this machine.
    * @param arr The array to be sorted.
-   * @param M The number of runs to be created.
+   * @param M The memory limit in bytes.
    */
   void autoExternalSort(std::vector<int64_t>& arr, size_t M);
 
+  /**
+   * @brief Predicts what externalSort(arr, M, a) costs on N keys without
+   * running it.
+   *
+   * Run sizes and merge steps are computed the way externalSort computes
+   * them, so the counters are exact for the fixed-size sequential
+   * configuration. Replacement selection is assumed to produce runs of
+   * twice the heap, and the parallel merge to split its runs evenly.
+   * @param N The number of keys.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  SortExplanation explain(size_t N, size_t M, size_t a) const;
+
+  /**
+   * @brief Sorts a binary file of 64-bit integers into another file without
+   * loading the whole input into memory.
+   * @param inputPath The file to be sorted.
+   * @param outputPath The file that receives the sorted sequence.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  void sortFile(const std::string& inputPath, const std::string& outputPath,
+                size_t M, size_t a);
+
+  /**
+   * @brief Sorts a binary file of 64-bit integers and streams the final merge
+   * pass into a sink instead of an output file.
+   * @param inputPath The file to be sorted.
+   * @param sink The destination of the sorted blocks.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  void sortFileTo(const std::string& inputPath, const MergeSink& sink,
+                  size_t M, size_t a);
+
+  /**
+   * @brief Returns a sink that writes sorted blocks to a stream.
+   * @param out The output stream; it must outlive the sort.
+   * @param io The context that accounts the writes; pass ioContext() to
+   * include them in the statistics of this sort.
+   */
+  static MergeSink fileSink(std::ostream& out,
+                            IoContext& io = IoContext::global());
+
+  /**
+   * @brief Returns a sink that copies sorted blocks into consecutive
+   * positions of a caller-owned buffer.
+   * @param dest The start of a buffer large enough for the whole input.
+   */
+  static MergeSink bufferSink(int64_t* dest);
+
+  /**
+   * @brief Returns a sink that writes sorted blocks to a file descriptor,
+   * such as a pipe or a socket.
+   * @param fd The open file descriptor; it is not closed by the sink.
+   * @param io The context that accounts the writes.
+   */
+  static MergeSink descriptorSink(int fd, IoContext& io = IoContext::global());
+
+  /**
+   * @brief Selects how the initial runs are generated.
+   * @param mode The run generation strategy.
+   */
+  void setRunGeneration(RunGeneration mode);
+
+  /**
+   * @brief Sets the directory for run files, data/mergesort_temp by default.
+   * Sorts that run concurrently need separate directories.
+   * @param dir The directory; it is created when a sort starts.
+   */
+  void setTempDirectory(const std::string& dir);
+
+  /**
+   * @brief Sets the number of threads used to sort each initial run.
+   * @param threads The number of sorting threads; 1 disables parallelism.
+   */
+  void setThreadCount(size_t threads);
+
+  /**
+   * @brief Selects the backend every file of this sorter is opened on.
+   * @param device The backend; null restores defaultBlockDevice().
+   */
+  void setBlockDevice(std::shared_ptr<BlockDevice> device);
+
+  /**
+   * @brief Configures the asynchronous queue that carries the batched
+   * requests of each pass.
+   * @param depth The requests kept in flight, at least 1.
+   * @param kind The backend; io_uring falls back to a thread pool.
+   */
+  void setIoQueue(size_t depth, IoQueueKind kind = IoQueueKind::Auto);
+
+  /**
+   * @brief Returns the context that accounts the I/O of this sorter.
+   */
+  IoContext& ioContext() { return io; }
+
+  /**
+   * @brief Returns the I/O statistics of the last sort.
+   */
+  IoStats ioStats() const { return io.stats(); }
+
+  /**
+   * @brief Plans a minimum-volume merge tree for runs of the given sizes.
+   *
+   * Like a Huffman code of arity a, the smallest runs are always merged
+   * first. The first merge takes (K - 1) mod (a - 1) + 1 runs, which is
+   * equivalent to padding with empty dummy runs, so every later merge is a
+   * full a-way merge.
+   * @param runSizes The number of elements of each run.
+   * @param a The merge arity.
+   * @return The merges in execution order; the last one produces the output.
+   */
+  static std::vector<MergeStep> planMerges(const std::vector<size_t>& runSizes,
+                                           size_t a);
+
  private:
   /**
-   * @brief Merges two sorted subarrays into a single sorted array.
-   * @param arr The array containing the subarrays.
-   * @param left The starting index of the left subarray.
-   * @param mid The ending index of the left subarray.
-   * @param right The ending index of the right subarray.
+   * @brief Fills a buffer with up to count input elements and returns how
+   * many were written; zero marks the end of the input.
+   */
+  using RunSource = std::function<size_t(int64_t*, size_t)>;
+
+  /**
+   * @brief Half-open element range [begin, end) of a run file.
    */
-  void merge(std::vector<int>& arr, int left, int mid, int right);
+  struct RunRange {
+    size_t begin;
+    size_t end;
+  };
 
   /**
-   * @brief Merges two sorted subarrays into a single sorted array.
-   * @param arr The array containing the subarrays.
-   * @param left The starting index of the left subarray.
-   * @param mid The ending index of the left subarray.
-   * @param right The ending index of the right subarray.
+   * @brief Destination of a merge. at(offset) returns a sink that receives
+   * the output from the given element offset on; positional outputs accept
+   * sinks at several offsets concurrently, which enables the parallel merge.
    */
-  void mergeSort(std::vector<int>& arr, int left, int right);
+  struct MergeOutput {
+    std::function<MergeSink(size_t)> at;
+    bool positional;
+  };
+
+  RunGeneration runGeneration = RunGeneration::FixedSize;
+  size_t threadCount = 1;
+  std::string tempDirectory = "data/mergesort_temp";
+  IoContext io;
 
   /**
    * @brief Creates initial runs of sorted data from the input array.
-   * @param arr The input array.
+   * @param data The input array.
+   * @param n The number of elements.
    * @param runSize The size of each run.
    * @param tempDir The directory to store temporary files.
    */
-  std::vector<std::string> createInitialRuns(const std::vector<int64_t>& arr,
+  std::vector<std::string> createInitialRuns(const int64_t* data, size_t n,
                                              size_t runSize,
                                              const std::string& tempDir);
 
   /**
-   * @brief Merges multiple sorted runs into a single sorted array.
+   * @brief Creates initial runs by streaming the input file one run at a time.
+   * @param inputPath The input file.
+   * @param runSize The size of each run.
+   * @param tempDir The directory to store temporary files.
+   */
+  std::vector<std::string> createInitialRunsFromFile(
+      const std::string& inputPath, size_t runSize,
+      const std::string& tempDir);
+
+  /**
+   * @brief Writes the runs of a source using the selected strategy.
+   * @param source The input source.
+   * @param runSize The number of elements the run stage may hold in memory.
+   * @param tempDir The directory to store temporary files.
+   */
+  std::vector<std::string> generateRuns(const RunSource& source,
+                                        size_t runSize,
+                                        const std::string& tempDir);
+
+  /**
+   * @brief Sorts consecutive slices of runSize elements into runs.
+   * @param source The input source.
+   * @param runSize The size of each run.
+   * @param tempDir The directory to store temporary files.
+   */
+  std::vector<std::string> generateFixedSizeRuns(const RunSource& source,
+                                                 size_t runSize,
+                                                 const std::string& tempDir);
+
+  /**
+   * @brief Sorts slices of a run on the pool and merges them into the run
+   * file.
+   * @param run The unsorted run; its slices are sorted in place.
+   * @param scratch Radix sort scratch of at least run.size() elements.
+   * @param runFile The run file to write.
+   * @param ioSize The size of the merge output buffer.
+   * @param pool The pool that sorts the slices.
+   */
+  void writeParallelSortedRun(AlignedVector<int64_t>& run, int64_t* scratch,
+                              const std::string& runFile, size_t ioSize,
+                              ThreadPool& pool);
+
+  /**
+   * @brief Generates runs with replacement selection over a heap of about
+   * runSize elements.
+   * @param source The input source.
+   * @param runSize The number of elements the heap and its buffers may hold.
+   * @param tempDir The directory to store temporary files.
+   */
+  std::vector<std::string> generateReplacementSelectionRuns(
+      const RunSource& source, size_t runSize, const std::string& tempDir);
+
+  /**
+   * @brief Merges sorted run files into a single file, following the plan
+   * from planMerges when there are more than a runs.
    * @param runFiles The list of sorted run files.
    * @param outputFile The output file to store the merged result.
-   * @param M The number of runs to be merged.
-   * @param a The size of each run.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
    */
   void mergeRuns(const std::vector<std::string>& runFiles,
                  const std::string& outputFile, size_t M, size_t a);
 
   /**
-   * @brief Merges multiple sorted runs into a single sorted array.
+   * @brief Merges sorted run files into a merge output; only the last merge
+   * of the plan writes to it.
+   * @param runFiles The list of sorted run files.
+   * @param output The destination of the merged result.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  void mergeRuns(const std::vector<std::string>& runFiles,
+                 const MergeOutput& output, size_t M, size_t a);
+
+  /**
+   * @brief Merges at most a runs into outputFile in a single pass.
+   * @param runFiles The list of sorted run files.
+   * @param output The destination of the merged result.
+   * @param M The memory limit in bytes.
+   */
+  void mergeBatch(const std::vector<std::string>& runFiles,
+                  const MergeOutput& output, size_t M);
+
+  /**
+   * @brief Creates (or truncates) a file and returns it as a positional
+   * merge output.
+   * @param path The output file.
+   */
+  MergeOutput fileOutput(const std::string& path);
+
+  /**
+   * @brief Returns a caller buffer as a positional merge output.
+   * @param dest The start of the buffer.
+   */
+  static MergeOutput bufferOutput(int64_t* dest);
+
+  /**
+   * @brief Wraps an in-order sink as a merge output.
+   * @param sink The sink.
+   */
+  static MergeOutput sinkOutput(const MergeSink& sink);
+
+  /**
+   * @brief Creates the initial runs of a file for sortFile and sortFileTo.
+   * @param inputPath The file to be sorted.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
+   */
+  std::vector<std::string> createSortFileRuns(const std::string& inputPath,
+                                              size_t M, size_t a);
+
+  /**
+   * @brief Merges the given range of every run into a sink, prefetching the
+   * runs and writing the output in the background.
+   * @param runFiles The list of sorted run files.
+   * @param ranges The range to merge from each run.
+   * @param sink The destination of the merged blocks.
+   * @param bufferSize The size of each run and output buffer in elements.
+   */
+  void mergeRange(const std::vector<std::string>& runFiles,
+                  const std::vector<RunRange>& ranges, const MergeSink& sink,
+                  size_t bufferSize);
+
+  /**
+   * @brief Splits the runs into disjoint key ranges of similar size using
+   * sampled splitters and a binary search in every run.
+   * @param runFiles The list of sorted run files.
+   * @param ranges The range of every run to split.
+   * @param parts The number of key ranges to produce.
+   * @return For every key range, the matching range of each run.
+   */
+  std::vector<std::vector<RunRange>> splitRanges(
+      const std::vector<std::string>& runFiles,
+      const std::vector<RunRange>& ranges, size_t parts);
+
+  /**
+   * @brief Merges runs on threadCount threads, each one writing its key
+   * range at a precomputed offset of the output file.
+   * @param runFiles The list of sorted run files.
+   * @param ranges The range to merge from each run.
+   * @param output The positional destination of the merged result.
+   * @param M The memory limit in bytes.
+   */
+  void mergeRunsParallel(const std::vector<std::string>& runFiles,
+                         const std::vector<RunRange>& ranges,
+                         const MergeOutput& output, size_t M);
+
+  /**
+   * @brief Merges multiple sorted runs straight into the caller's array.
    * @param runFiles The list of sorted run files.
-   * @param output The output array to store the merged result.
-   * @param M The number of runs to be merged.
+   * @param output The output array, with room for every element of the
+   * runs.
+   * @param M The memory limit in bytes.
+   * @param a The merge arity.
    */
   void mergeSortedRuns(const std::vector<std::string>& runFiles,
-                       std::vector<int64_t>& output, size_t M, size_t a);
+                       int64_t* output, size_t M, size_t a);
 };
 
 #endif
\ No newline at end of file
@@ -3,8 +3,22 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "utils/io_context.h"
+#include "utils/partition_writer.h"
+#include "utils/quantile_sketch.h"
+#include "utils/sort_planner.h"
+
+class MemoryBudget;
+class TaskGroup;
+class ThreadPool;
+template <typename T>
+class SplitterTree;
+
 /**
  * @brief QuickSort class provides methods for sorting arrays using the
  * quicksort algorithm.
@@ -20,29 +34,228 @@ class QuickSort {
   void sort(std::vector<int64_t>& arr, size_t M, size_t a);
 
   /**
-   * @brief Auto-sorts an array of integers using the quicksort algorithm.
+   * @brief Sorts n keys into output, reading them in place from input, such
+   * as the data() of a MappedFile, without copying the whole input first.
+   * Costs what explain(n, M, a) predicts. If the external sort fails, the
+   * input is sorted in memory instead, unless sorted partitions have
+   * already been written over it; then the error is rethrown.
+   * @param input The keys to sort.
+   * @param n The number of keys.
+   * @param output Room for n keys; it may be input itself.
+   * @param M The memory limit in bytes.
+   * @param a The number of partitions per level.
+   */
+  void sortView(const int64_t* input, size_t n, int64_t* output, size_t M,
+                size_t a);
+
+  /**
+   * @brief Auto-sorts an array of integers using the quicksort algorithm,
+   * with the arity planSort predicts to be fastest on this machine.
    * @param arr The array to be sorted.
-   * @param M The number of runs to be created.
+   * @param M The memory limit in bytes.
    */
   void autoSort(std::vector<int64_t>& arr, size_t M);
 
+  /**
+   * @brief Predicts what sort(arr, M, a) costs on N keys without running
+   * it, assuming distinct keys so that the sketch pivots split every
+   * partition evenly and no equality bucket is created. Partitions are
+   * visited in order, as with a single thread.
+   * @param N The number of keys.
+   * @param M The memory limit in bytes.
+   * @param a The number of partitions per level.
+   */
+  SortExplanation explain(size_t N, size_t M, size_t a) const;
+
+  /**
+   * @brief Sorts a binary file of 64-bit integers into another file without
+   * loading the whole input into memory.
+   * @param inputPath The file to be sorted.
+   * @param outputPath The file that receives the sorted sequence; it may
+   * be inputPath.
+   * @param M The memory limit in bytes.
+   * @param a The number of partitions per level.
+   */
+  void sortFile(const std::string& inputPath, const std::string& outputPath,
+                size_t M, size_t a);
+
+  /**
+   * @brief Sets the number of threads that sort independent partitions
+   * concurrently. Their buffers share the memory limit M.
+   * @param threads The number of sorting threads; 1 disables parallelism.
+   */
+  void setThreadCount(size_t threads);
+
+  /**
+   * @brief Selects the backend every file of this sorter is opened on.
+   * @param device The backend; null restores defaultBlockDevice().
+   */
+  void setBlockDevice(std::shared_ptr<BlockDevice> device);
+
+  /**
+   * @brief Configures the asynchronous queue that carries the batched
+   * requests of each pass.
+   * @param depth The requests kept in flight, at least 1.
+   * @param kind The backend; io_uring falls back to a thread pool.
+   */
+  void setIoQueue(size_t depth, IoQueueKind kind = IoQueueKind::Auto);
+
+  /**
+   * @brief Returns the I/O statistics of the last sort.
+   */
+  IoStats ioStats() const { return io.stats(); }
+
  private:
   /**
-   * @brief Partitions the array into subarrays based on the pivot values.
-   * @param arr The array to be partitioned.
-   * @param pivots The pivot values.
-   * @param subarrays The resulting subarrays.
+   * @brief Number of elements classified per SplitterTree call while
+   * partitioning; their partition indices live on a small side buffer.
+   */
+  static constexpr size_t CLASSIFY_CHUNK = 256;
+
+  /**
+   * @brief Minimum number of elements each thread classifies in a parallel
+   * partitioning pass; smaller read blocks are distributed on one thread.
+   */
+  static constexpr size_t PARALLEL_SLICE_SIZE = 4096;
+
+  size_t threadCount = 1;
+  IoContext io;
+
+  /**
+   * @brief Sorts a partition that fits in memory, with the radix kernel when
+   * its scratch buffer also fits in M.
+   * @param data The partition.
+   * @param n The number of elements.
+   * @param M The memory limit in bytes.
+   */
+  static void sortInMemory(int64_t* data, size_t n, size_t M);
+
+  /**
+   * @brief Random-access view of the elements of a partition. read(offset,
+   * dest, count) copies up to count elements starting at offset and returns
+   * how many it copied; file reads are accounted by the sorter's IoContext.
+   * sketch summarizes the keys when a previous pass has already seen them.
+   * data points to the elements when they are already in memory, so a pass
+   * can classify them in place instead of reading them.
+   */
+  struct PartitionInput {
+    size_t size;
+    std::function<size_t(size_t, int64_t*, size_t)> read;
+    std::shared_ptr<const QuantileSketch> sketch;
+    const int64_t* data = nullptr;
+  };
+
+  /**
+   * @brief Writes count sorted elements at the given element offset of the
+   * final output.
+   */
+  using PartitionOutput = std::function<void(size_t, const int64_t*, size_t)>;
+
+  /**
+   * @brief Output side of one partitioning pass: a file, a write-behind
+   * writer and running statistics for each partition.
    */
-  void partition(std::vector<int64_t>& arr, std::vector<int64_t>& pivots,
-                 std::vector<std::vector<int64_t>>& subarrays);
+  struct PartitionWriters {
+    std::vector<std::string> files;
+    std::unique_ptr<PartitionWriterSet> set;
+    std::vector<size_t> sizes;
+    std::vector<int64_t> minKeys;
+    std::vector<int64_t> maxKeys;
+    std::vector<QuantileSketch> sketches;
+  };
+
+  /**
+   * @brief Returns an input that reads a binary file of 64-bit integers.
+   * @param path The file to read.
+   */
+  PartitionInput fileInput(const std::string& path);
+
+  /**
+   * @brief Returns an input that reads an in-memory array. The array must
+   * outlive the input.
+   * @param data The array to read.
+   * @param size The number of elements.
+   */
+  static PartitionInput arrayInput(const int64_t* data, size_t size);
 
   /**
    * @brief External quicksort algorithm for sorting large arrays.
-   * @param arr The array to be sorted.
-   * @param M The number of runs to be created.
-   * @param a The size of each run.
+   * @param input The elements to sort.
+   * @param n The number of elements.
+   * @param output Room for n elements; it may be input itself.
+   * @param M The memory limit in bytes.
+   * @param a The number of partitions per level.
+   */
+  void externalQuickSort(const int64_t* input, size_t n, int64_t* output,
+                         size_t M, size_t a);
+
+  /**
+   * @brief Builds an exact sketch of keys sampled at random positions.
+   * @param input The elements to sample.
+   * @param sampleSize The number of samples.
+   */
+  static std::shared_ptr<const QuantileSketch> sampleInput(
+      const PartitionInput& input, size_t sampleSize);
+
+  /**
+   * @brief Runs distributionSort on the whole input, with a worker pool when
+   * threadCount > 1, and waits for every partition task.
+   * @param input The elements to sort.
+   * @param output The destination of the sorted elements.
+   * @param M The memory limit in bytes, shared by all tasks.
+   * @param a The number of partitions per level.
+   */
+  void runDistributionSort(const PartitionInput& input,
+                           const PartitionOutput& output, size_t M, size_t a);
+
+  /**
+   * @brief File-to-file distribution sort. The input is split into
+   * partition files by sampled pivots; each partition that fits in M is
+   * sorted in memory and written at its final offset, known from the sizes
+   * of the partitions before it, and larger ones are partitioned again.
+   * @param input The elements to sort.
+   * @param output The destination of the sorted elements.
+   * @param outputOffset The output offset of the first sorted element.
+   * @param M The memory limit in bytes.
+   * @param a The number of partitions per level.
+   * @param depth The recursion depth, used to name temporary files.
+   * @param tasks The group that runs the sorts of the partitions.
+   * @param budget The memory budget reserved before allocating buffers.
+   */
+  void distributionSort(const PartitionInput& input,
+                        const PartitionOutput& output, size_t outputOffset,
+                        size_t M, size_t a, size_t depth, TaskGroup& tasks,
+                        MemoryBudget& budget);
+
+  /**
+   * @brief Appends a block of input to the partition buffers, flushing
+   * buffers that fill up.
+   * @param block The elements to distribute.
+   * @param n The number of elements.
+   * @param classifier The classifier built from the pass pivots.
+   * @param buckets Scratch for CLASSIFY_CHUNK partition indices.
+   * @param writers The partitions of the pass.
+   */
+  void distributeBlock(const int64_t* block, size_t n,
+                       const SplitterTree<int64_t>& classifier,
+                       uint32_t* buckets, PartitionWriters& writers);
+
+  /**
+   * @brief Same as distributeBlock, with the block split into slices that
+   * are classified and scattered by several threads. Thread-local counts
+   * give every slice a disjoint range of each partition buffer, so neither
+   * the scatter nor the flushes of different partitions take a lock.
+   * @param block The elements to distribute.
+   * @param n The number of elements.
+   * @param classifier The classifier built from the pass pivots.
+   * @param buckets Scratch for n partition indices.
+   * @param writers The partitions of the pass.
+   * @param pool The pool that helps with the slices.
    */
-  void externalQuickSort(std::vector<int64_t>& arr, size_t M, size_t a);
+  void distributeBlockParallel(const int64_t* block, size_t n,
+                               const SplitterTree<int64_t>& classifier,
+                               uint32_t* buckets, PartitionWriters& writers,
+                               ThreadPool& pool);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,163 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/io_context.h"
+#include "utils/sort_planner.h"
+
+/**
+ * @brief RadixSort class provides methods for sorting arrays of 64-bit
+ * integers with an external MSD radix distribution sort.
+ *
+ * Each pass streams its input once and sends every key to one of 2^b
+ * buckets by the b most significant bits of its offset from the smallest
+ * key, with no comparisons and no pivots. Buckets that fit in M are sorted
+ * in memory with the LSD radix kernel and written at their final offset;
+ * larger ones are distributed again on their own key range.
+ */
+class RadixSort {
+ public:
+  /**
+   * @brief Sorts an array of 64-bit integers.
+   * @param arr The array to be sorted.
+   * @param M The memory limit in bytes.
+   * @param a The number of buckets per pass, rounded down to a power of two.
+   */
+  void sort(std::vector<int64_t>& arr, size_t M, size_t a);
+
+  /**
+   * @brief Sorts n keys into output, reading them in place from input, such
+   * as the data() of a MappedFile, without copying the whole input first.
+   * Costs what explain(n, M, a) predicts.
+   * @param input The keys to sort.
+   * @param n The number of keys.
+   * @param output Room for n keys; it may be input itself.
+   * @param M The memory limit in bytes.
+   * @param a The number of buckets per pass, rounded down to a power of two.
+   */
+  void sortView(const int64_t* input, size_t n, int64_t* output, size_t M,
+                size_t a);
+
+  /**
+   * @brief Sorts an array of 64-bit integers with the number of buckets
+   * planSort predicts to be fastest on this machine.
+   * @param arr The array to be sorted.
+   * @param M The memory limit in bytes.
+   */
+  void autoSort(std::vector<int64_t>& arr, size_t M);
+
+  /**
+   * @brief Predicts what sort(arr, M, a) costs on N keys without running
+   * it, assuming keys spread uniformly over a power-of-two range, as
+   * full-width random keys do, so that every bucket of a pass receives the
+   * same share.
+   * @param N The number of keys.
+   * @param M The memory limit in bytes.
+   * @param a The number of buckets per pass, rounded down to a power of two.
+   */
+  SortExplanation explain(size_t N, size_t M, size_t a) const;
+
+  /**
+   * @brief Sorts a binary file of 64-bit integers into another file without
+   * loading the whole input into memory.
+   * @param inputPath The file to be sorted.
+   * @param outputPath The file that receives the sorted sequence; it may
+   * be inputPath.
+   * @param M The memory limit in bytes.
+   * @param a The number of buckets per pass, rounded down to a power of two.
+   */
+  void sortFile(const std::string& inputPath, const std::string& outputPath,
+                size_t M, size_t a);
+
+  /**
+   * @brief Selects the backend every file of this sorter is opened on.
+   * @param device The backend; null restores defaultBlockDevice().
+   */
+  void setBlockDevice(std::shared_ptr<BlockDevice> device);
+
+  /**
+   * @brief Returns the I/O statistics of the last sort.
+   */
+  IoStats ioStats() const { return io.stats(); }
+
+ private:
+  IoContext io;
+
+  /**
+   * @brief Random-access view of the keys of a bucket. read(offset, dest,
+   * count) copies up to count keys starting at offset and returns how many
+   * it copied; file reads are accounted by the sorter's IoContext. data
+   * points to the keys when they are already in memory, so a pass can
+   * classify them in place instead of reading them.
+   */
+  struct BucketInput {
+    size_t size;
+    std::function<size_t(size_t, int64_t*, size_t)> read;
+    const int64_t* data = nullptr;
+  };
+
+  /**
+   * @brief Writes count sorted keys at the given offset of the output.
+   */
+  using BucketOutput = std::function<void(size_t, const int64_t*, size_t)>;
+
+  /**
+   * @brief Returns an input that reads a binary file of 64-bit integers.
+   * @param path The file to read.
+   */
+  BucketInput fileInput(const std::string& path);
+
+  /**
+   * @brief Returns an input that reads an in-memory array. The array must
+   * outlive the input.
+   * @param data The array to read.
+   * @param size The number of keys.
+   */
+  static BucketInput arrayInput(const int64_t* data, size_t size);
+
+  /**
+   * @brief Maps a key to an unsigned value with the same order.
+   */
+  static uint64_t toUnsigned(int64_t key);
+
+  /**
+   * @brief Returns the number of bits a pass distributes on for arity a,
+   * floor(log2(a)) clamped to [1, 16].
+   */
+  static size_t bucketBits(size_t a);
+
+  /**
+   * @brief Sorts a bucket that fits in memory, with the LSD radix kernel
+   * when its scratch buffer also fits in M.
+   * @param data The bucket.
+   * @param n The number of keys.
+   * @param M The memory limit in bytes.
+   */
+  static void sortInMemory(int64_t* data, size_t n, size_t M);
+
+  /**
+   * @brief Distributes the input into buckets over [low, high] and sorts
+   * each of them into the output. Keys outside the range are clamped into
+   * the first or last bucket, which keeps the buckets ordered when the range
+   * is only an estimate.
+   * @param input The keys to sort.
+   * @param output The destination of the sorted keys.
+   * @param outputOffset The output offset of the first sorted key.
+   * @param low The smallest key expected.
+   * @param high The largest key expected.
+   * @param M The memory limit in bytes.
+   * @param bits The number of bits each pass distributes on.
+   * @param depth The recursion depth, used to name temporary files.
+   */
+  void distribute(const BucketInput& input, const BucketOutput& output,
+                  size_t outputOffset, int64_t low, int64_t high, size_t M,
+                  size_t bits, size_t depth);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SPLITTER_TREE_H
+#define SPLITTER_TREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils/aligned_buffer_pool.h"
+
+/**
+ * @brief Branchless classifier that maps keys to the partitions defined by a
+ * sorted set of pivots, as in super scalar samplesort.
+ *
+ * The pivots are padded to 2^L - 1 by repeating the largest one and stored
+ * as an implicit binary search tree in BUFFER_ALIGNMENT-aligned storage,
+ * so the top levels share a cache line. A lookup descends L levels with
+ * i = 2 * i + (tree[i] <= key), which compiles to a conditional add instead
+ * of a branch. classify() interleaves a batch of keys level by level so
+ * that their independent descents overlap in the pipeline.
+ *
+ * Partition i holds the keys with pivots[i - 1] <= key < pivots[i].
+ *
+ * @tparam T The key type.
+ */
+template <typename T>
+class SplitterTree {
+ public:
+  /**
+   * @brief Number of keys interleaved by classify().
+   */
+  static constexpr size_t BATCH = 8;
+
+  /**
+   * @brief Builds the tree.
+   * @param pivots The pivots, sorted and without duplicates.
+   */
+  explicit SplitterTree(const std::vector<T>& pivots)
+      : pivotCount(pivots.size()) {
+    levels = 0;
+    while ((size_t(1) << levels) <= pivotCount) {
+      levels++;
+    }
+    leaves = size_t(1) << levels;
+
+    // Node i lives at storage[i]; storage[0] is unused.
+    storage.resize(leaves);
+
+    if (pivotCount > 0) {
+      std::vector<T> padded(leaves - 1, pivots.back());
+      std::copy(pivots.begin(), pivots.end(), padded.begin());
+      size_t next = 0;
+      fill(1, padded, next);
+    }
+  }
+
+  /**
+   * @brief Returns the number of partitions, pivots.size() + 1.
+   */
+  size_t partitions() const { return pivotCount + 1; }
+
+  /**
+   * @brief Returns the partition of a single key.
+   */
+  size_t find(const T& key) const {
+    const T* tree = storage.data();
+    size_t i = 1;
+    for (size_t level = 0; level < levels; level++) {
+      i = 2 * i + static_cast<size_t>(tree[i] <= key);
+    }
+    return std::min(i - leaves, pivotCount);
+  }
+
+  /**
+   * @brief Classifies n keys, writing the partition of keys[i] to out[i].
+   * @param keys The keys to classify.
+   * @param n The number of keys.
+   * @param out Destination of the partition indices.
+   */
+  void classify(const T* keys, size_t n, uint32_t* out) const {
+    const T* tree = storage.data();
+    size_t done = 0;
+    for (; done + BATCH <= n; done += BATCH) {
+      size_t idx[BATCH];
+      for (size_t b = 0; b < BATCH; b++) {
+        idx[b] = 1;
+      }
+      for (size_t level = 0; level < levels; level++) {
+        for (size_t b = 0; b < BATCH; b++) {
+          idx[b] = 2 * idx[b] +
+                   static_cast<size_t>(tree[idx[b]] <= keys[done + b]);
+        }
+      }
+      for (size_t b = 0; b < BATCH; b++) {
+        out[done + b] =
+            static_cast<uint32_t>(std::min(idx[b] - leaves, pivotCount));
+      }
+    }
+    for (; done < n; done++) {
+      out[done] = static_cast<uint32_t>(find(keys[done]));
+    }
+  }
+
+ private:
+  // In-order traversal of the implicit tree assigns the sorted pivots.
+  void fill(size_t node, const std::vector<T>& sorted, size_t& next) {
+    if (node >= leaves) return;
+    fill(2 * node, sorted, next);
+    storage[node] = sorted[next++];
+    fill(2 * node + 1, sorted, next);
+  }
+
+  size_t pivotCount;
+  size_t levels;
+  size_t leaves;
+  AlignedVector<T> storage;
+};
+
+#endif  // SPLITTER_TREE_H
@@ -0,0 +1,172 @@
+#ifndef ALIGNED_BUFFER_POOL_H
+#define ALIGNED_BUFFER_POOL_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Alignment of the buffers handed out by AlignedBufferPool, the
+ * block size direct I/O requires of addresses, offsets and lengths.
+ */
+constexpr size_t BUFFER_ALIGNMENT = 4096;
+
+/**
+ * @brief Recycles BUFFER_ALIGNMENT-aligned buffers.
+ *
+ * Sizes are rounded up to a multiple of BUFFER_ALIGNMENT. Released buffers
+ * are kept for later requests of the same rounded size, so repeated passes
+ * reuse their memory instead of going back to the allocator. Idle buffers
+ * are only kept while the pool's idle and live bytes together stay within
+ * its capacity; an allocation that would go beyond it frees idle buffers
+ * first. Thread-safe.
+ */
+class AlignedBufferPool {
+ public:
+  /**
+   * @brief Limits global() to the memory budget of one sort.
+   *
+   * The sort engines hold one for each sort. While it lives, idle buffers
+   * kept between passes count against M together with the live ones, so a
+   * pass does not leave its buffers resident on top of the next pass's.
+   * On destruction the idle buffers are freed and the previous capacity
+   * comes back. With concurrent sorts the latest scope's M applies.
+   */
+  class SortScope {
+   public:
+    /**
+     * @param M The memory budget of the sort in bytes.
+     */
+    explicit SortScope(size_t M) : previous(global().setCapacity(M)) {}
+    ~SortScope() {
+      global().trim();
+      global().setCapacity(previous);
+    }
+
+    SortScope(const SortScope&) = delete;
+    SortScope& operator=(const SortScope&) = delete;
+
+   private:
+    size_t previous;
+  };
+
+  /**
+   * @brief Creates a pool.
+   * @param capacity The most idle and live bytes together beyond which
+   * released buffers are freed rather than kept.
+   */
+  explicit AlignedBufferPool(size_t capacity = 64 * 1024 * 1024);
+  ~AlignedBufferPool();
+
+  AlignedBufferPool(const AlignedBufferPool&) = delete;
+  AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+  /**
+   * @brief Returns an aligned buffer of at least bytes bytes. Throws
+   * std::bad_alloc if memory runs out.
+   */
+  void* acquire(size_t bytes);
+
+  /**
+   * @brief Returns a buffer obtained from acquire().
+   * @param buffer The buffer.
+   * @param bytes The size passed to acquire().
+   */
+  void release(void* buffer, size_t bytes);
+
+  /**
+   * @brief Frees every idle buffer.
+   */
+  void trim();
+
+  /**
+   * @brief Changes the capacity, freeing idle buffers beyond it.
+   * @return The previous capacity.
+   */
+  size_t setCapacity(size_t bytes);
+
+  /**
+   * @brief Returns the bytes currently kept for reuse.
+   */
+  size_t idleBytes() const;
+
+  /**
+   * @brief Returns the bytes of the buffers currently handed out.
+   */
+  size_t liveBytes() const;
+
+  /**
+   * @brief Returns the most idle and live bytes held together since the
+   * last resetPeak().
+   */
+  size_t peakBytes() const;
+
+  /**
+   * @brief Restarts peakBytes() from the bytes held now.
+   */
+  void resetPeak();
+
+  /**
+   * @brief Returns how many buffers were allocated rather than reused.
+   */
+  size_t allocations() const;
+
+  /**
+   * @brief Returns the pool shared by AlignedAllocator and the direct I/O
+   * backend.
+   */
+  static AlignedBufferPool& global();
+
+ private:
+  static size_t roundUp(size_t bytes);
+  void evict(size_t incoming, std::vector<void*>& evicted);
+
+  size_t capacity;
+  size_t idle = 0;
+  size_t live = 0;
+  size_t peak = 0;
+  size_t allocated = 0;
+  std::multimap<size_t, void*> freeBuffers;
+  mutable std::mutex mutex;
+};
+
+/**
+ * @brief Allocator that takes its memory from AlignedBufferPool::global(),
+ * so the data of a container can be handed to direct I/O without a copy.
+ */
+template <typename T>
+class AlignedAllocator {
+ public:
+  using value_type = T;
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(AlignedBufferPool::global().acquire(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    AlignedBufferPool::global().release(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U>&) const {
+    return false;
+  }
+};
+
+/**
+ * @brief A vector whose storage is aligned to BUFFER_ALIGNMENT.
+ */
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif  // ALIGNED_BUFFER_POOL_H
@@ -0,0 +1,126 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @brief How a BlockDevice opens a file.
+ *
+ * Write creates or truncates, Update creates if missing and keeps the
+ * contents, Append creates if missing and writes at the end.
+ */
+enum class OpenMode { Read, Write, Update, Append };
+
+/**
+ * @brief An open file of a BlockDevice, addressed by byte offset.
+ *
+ * Positional reads and writes may be issued from several threads at once;
+ * appends are serialized by the caller.
+ */
+class BlockFile {
+ public:
+  virtual ~BlockFile() = default;
+
+  /**
+   * @brief Reads up to bytes bytes at offset.
+   * @param offset The byte offset.
+   * @param dest The destination buffer.
+   * @param bytes The number of bytes requested.
+   * @return The bytes read; fewer than requested only at the end of file.
+   */
+  virtual size_t read(size_t offset, void* dest, size_t bytes) = 0;
+
+  /**
+   * @brief Writes bytes bytes at offset, extending the file if needed.
+   * @param offset The byte offset.
+   * @param src The data to write.
+   * @param bytes The number of bytes.
+   */
+  virtual void write(size_t offset, const void* src, size_t bytes) = 0;
+
+  /**
+   * @brief Writes bytes bytes at the end of the file.
+   * @param src The data to write.
+   * @param bytes The number of bytes.
+   */
+  virtual void append(const void* src, size_t bytes) = 0;
+
+  /**
+   * @brief Returns the current size of the file in bytes.
+   */
+  virtual size_t size() const = 0;
+
+  /**
+   * @brief Returns the file descriptor an asynchronous IoQueue may issue
+   * requests on, or -1 if the file must be accessed through this interface.
+   */
+  virtual int descriptor() const { return -1; }
+};
+
+/**
+ * @brief Backend that opens files for the sort engines. Engines reach it
+ * through an IoContext, which accounts every request it serves.
+ */
+class BlockDevice {
+ public:
+  virtual ~BlockDevice() = default;
+
+  /**
+   * @brief Opens a file.
+   * @param path The file path.
+   * @param mode How to open it.
+   * @return The open file; throws std::runtime_error on failure.
+   */
+  virtual std::unique_ptr<BlockFile> open(const std::string& path,
+                                          OpenMode mode) = 0;
+
+  /**
+   * @brief Returns a short name of the backend, for reports.
+   */
+  virtual std::string name() const = 0;
+
+  /**
+   * @brief Returns the alignment, in bytes, of the offsets, lengths and
+   * buffers that the backend transfers without staging.
+   */
+  virtual size_t alignment() const { return 1; }
+};
+
+/**
+ * @brief Buffered POSIX backend: pread, pwrite and write on a file
+ * descriptor, through the page cache.
+ */
+class PosixBlockDevice : public BlockDevice {
+ public:
+  std::unique_ptr<BlockFile> open(const std::string& path,
+                                  OpenMode mode) override;
+  std::string name() const override { return "posix"; }
+};
+
+/**
+ * @brief Direct I/O backend: files are opened with O_DIRECT and bypass the
+ * page cache, so the sort reads and writes the disk rather than RAM.
+ *
+ * Transfers whose offset, length and buffer are aligned to
+ * BUFFER_ALIGNMENT go straight to the disk; the rest, such as the unaligned
+ * tail of a file, are staged through buffers of AlignedBufferPool::global().
+ * Files report no descriptor, so an IoQueue reaches them through the
+ * BlockFile interface. Opening fails on file systems without direct I/O.
+ */
+class DirectBlockDevice : public BlockDevice {
+ public:
+  std::unique_ptr<BlockFile> open(const std::string& path,
+                                  OpenMode mode) override;
+  std::string name() const override { return "direct"; }
+  size_t alignment() const override;
+};
+
+/**
+ * @brief Returns the backend used when none is chosen, shared by every
+ * IoContext that does not set its own.
+ */
+std::shared_ptr<BlockDevice> defaultBlockDevice();
+
+#endif  // BLOCK_DEVICE_H
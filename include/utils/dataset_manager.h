@@ -66,7 +66,6 @@ class DatasetManager {
   static std::vector<int> generateReverseSortedData(std::size_t size);
   static std::vector<int> generatePartiallySortedData(std::size_t size,
                                                       double sortedFraction);
-  static std::vector<int> generateRandomData(std::size_t size);
   static std::vector<int> generateTestData(std::size_t size);
 
  private:
@@ -1,41 +1,54 @@
 #ifndef FILE_HANDLER_H
 #define FILE_HANDLER_H
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <vector>
 
+#include "utils/io_context.h"
+
+/*
+ * Every function below issues its transfer as a single request through io,
+ * IoContext::global() unless an engine passes its own context.
+ */
+
 /**
  * @brief Reads a file and returns its contents as a vector of integers.
  * @param filename The name of the file to read.
  */
-std::vector<int> readFromFile(const std::string& filename);
+std::vector<int> readFromFile(const std::string& filename,
+                              IoContext& io = IoContext::global());
 
 /**
  * @brief Writes a vector of integers to a file.
  * @param filename The name of the file to write to.
  * @param data The vector of integers to write.
  */
-void writeToFile(const std::string& filename, const std::vector<int>& data);
+void writeToFile(const std::string& filename, const std::vector<int>& data,
+                 IoContext& io = IoContext::global());
 
 /**
  * @brief Reads a file and returns its contents as a vector of 64-bit integers.
  * @param filename The name of the file to read.
  */
-std::vector<int> readDataFromFile(const std::string& filename);
+std::vector<int> readDataFromFile(const std::string& filename,
+                                  IoContext& io = IoContext::global());
 
 /**
  * @brief Writes a vector of 64-bit integers to a file.
  * @param filename The name of the file to write to.
  * @param data The vector of 64-bit integers to write.
  */
-void writeDataToFile(const std::string& filename, const std::vector<int>& data);
+void writeDataToFile(const std::string& filename, const std::vector<int>& data,
+                     IoContext& io = IoContext::global());
 
 /**
  * @brief Reads a file and returns its contents as a vector of 64-bit integers.
  * @param filename The name of the file to read.
  */
-std::vector<int64_t> readInt64FromFile(const std::string& filename);
+std::vector<int64_t> readInt64FromFile(const std::string& filename,
+                                       IoContext& io = IoContext::global());
 
 /**
  * @brief Writes a vector of 64-bit integers to a file.
@@ -43,13 +56,15 @@ std::vector<int64_t> readInt64FromFile(const std::string& filename);
  * @param data The vector of 64-bit integers to write.
  */
 void writeInt64ToFile(const std::string& filename,
-                      const std::vector<int64_t>& data);
+                      const std::vector<int64_t>& data,
+                      IoContext& io = IoContext::global());
 
 /**
  * @brief Reads a file and returns its contents as a vector of 64-bit integers.
  * @param filename The name of the file to read.
  */
-std::vector<int64_t> readInt64DataFromFile(const std::string& filename);
+std::vector<int64_t> readInt64DataFromFile(
+    const std::string& filename, IoContext& io = IoContext::global());
 
 /**
  * @brief Writes a vector of 64-bit integers to a file.
@@ -57,7 +72,8 @@ std::vector<int64_t> readInt64DataFromFile(const std::string& filename);
  * @param data The vector of 64-bit integers to write.
  */
 void writeInt64DataToFile(const std::vector<int64_t>& data,
-                          const std::string& filename);
+                          const std::string& filename,
+                          IoContext& io = IoContext::global());
 
 /**
  * @brief Reads a block of data from a file.
@@ -66,7 +82,8 @@ void writeInt64DataToFile(const std::vector<int64_t>& data,
  * @param blockSize The size of the block to read.
  */
 std::vector<int64_t> readBlockFromFile(const std::string& filename,
-                                       size_t offset, size_t blockSize);
+                                       size_t offset, size_t blockSize,
+                                       IoContext& io = IoContext::global());
 /**
  * @brief Writes a block of data to a file.
  * @param filename The name of the file to write to.
@@ -74,14 +91,16 @@ std::vector<int64_t> readBlockFromFile(const std::string& filename,
  * @param offset The offset in the file to start writing to.
  */
 void writeBlockToFile(const std::string& filename,
-                      const std::vector<int64_t>& block, size_t offset);
+                      const std::vector<int64_t>& block, size_t offset,
+                      IoContext& io = IoContext::global());
 
 /**
  * @brief Appends a block of data to a file.
  * @param filename The name of the file to append to.
  */
 void appendInt64DataToFile(const std::vector<int64_t>& data,
-                           const std::string& filename);
+                           const std::string& filename,
+                           IoContext& io = IoContext::global());
 
 /**
  * @brief Generates a dataset of integers based on the specified parameters.
@@ -89,8 +108,13 @@ void appendInt64DataToFile(const std::vector<int64_t>& data,
  */
 static std::vector<int> generateTestData(std::size_t size);
 
-extern size_t disk_read_count;
-extern size_t disk_write_count;
+/*
+ * Process-wide request counters, kept as a compatibility view: every
+ * IoContext adds each request it serves to them. Per-sort statistics with
+ * bytes and blocks come from the engines' ioStats().
+ */
+extern std::atomic<size_t> disk_read_count;
+extern std::atomic<size_t> disk_write_count;
 void resetDiskCounters();
 size_t getDiskReadCount();
 size_t getDiskWriteCount();
@@ -0,0 +1,190 @@
+#ifndef IO_CONTEXT_H
+#define IO_CONTEXT_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "utils/block_device.h"
+#include "utils/io_queue.h"
+
+/**
+ * @brief Size of the blocks counted by IoStats, in bytes.
+ */
+constexpr size_t IO_BLOCK_SIZE = 4096;
+
+/**
+ * @brief Snapshot of the I/O served by an IoContext. A request is one call
+ * that moved data; blocks are the IO_BLOCK_SIZE-aligned blocks it touched,
+ * so a 1-byte read costs one block and an unaligned 4 KiB read two.
+ */
+struct IoStats {
+  size_t readRequests;
+  size_t writeRequests;
+  size_t bytesRead;
+  size_t bytesWritten;
+  size_t blocksRead;
+  size_t blocksWritten;
+};
+
+/**
+ * @brief Accounts the I/O of one sort and opens its files on a BlockDevice.
+ *
+ * Every engine owns a context and routes all of its disk access through it.
+ * Counters are atomic, so concurrent partitions and merge threads may share
+ * one context. Each request is also added to disk_read_count or
+ * disk_write_count, which remain the process-wide compatibility view.
+ */
+class IoContext {
+ public:
+  /**
+   * @brief A file opened through the context; every transfer that moves
+   * data is accounted as one request.
+   */
+  class File {
+   public:
+    File(File&&) = default;
+    File& operator=(File&&) = default;
+
+    /**
+     * @brief Reads up to bytes bytes at offset.
+     * @return The bytes read; fewer than requested only at the end of file.
+     */
+    size_t read(size_t offset, void* dest, size_t bytes);
+
+    /**
+     * @brief Writes bytes bytes at offset. Safe to call concurrently for
+     * disjoint ranges.
+     */
+    void write(size_t offset, const void* src, size_t bytes);
+
+    /**
+     * @brief Writes bytes bytes at the end of the file.
+     */
+    void append(const void* src, size_t bytes);
+
+    /**
+     * @brief Returns the current size of the file in bytes.
+     */
+    size_t size() const { return file->size(); }
+
+    /**
+     * @brief Returns the backend file, for requests issued on an IoQueue
+     * created by the same context.
+     */
+    BlockFile& blockFile() { return *file; }
+
+   private:
+    friend class IoContext;
+    File(IoContext& io, std::unique_ptr<BlockFile> file, size_t end);
+
+    IoContext* io;
+    std::unique_ptr<BlockFile> file;
+    size_t end;
+  };
+
+  /**
+   * @brief Creates a context with zeroed counters.
+   * @param device The backend, defaultBlockDevice() if null.
+   */
+  explicit IoContext(std::shared_ptr<BlockDevice> device = nullptr);
+
+  IoContext(const IoContext&) = delete;
+  IoContext& operator=(const IoContext&) = delete;
+
+  /**
+   * @brief Opens a file on the backend.
+   * @param path The file path.
+   * @param mode How to open it.
+   */
+  File open(const std::string& path, OpenMode mode);
+
+  /**
+   * @brief Replaces the backend. Only call it between sorts: open files
+   * keep the backend they were opened with.
+   * @param device The new backend, defaultBlockDevice() if null.
+   */
+  void setDevice(std::shared_ptr<BlockDevice> device);
+
+  /**
+   * @brief Returns the backend.
+   */
+  const BlockDevice& device() const { return *blockDevice; }
+
+  /**
+   * @brief Rounds a buffer length down to whole aligned blocks of the
+   * backend, so that transfers of consecutive buffers stay aligned.
+   * Lengths below one block are returned unchanged.
+   * @param count The length in elements.
+   * @param elementSize The size of an element in bytes.
+   */
+  size_t alignedCount(size_t count, size_t elementSize) const;
+
+  /**
+   * @brief Configures the queues returned by createQueue().
+   * @param depth The requests each queue keeps in flight, at least 1.
+   * @param kind The queue backend.
+   */
+  void setQueue(size_t depth, IoQueueKind kind = IoQueueKind::Auto);
+
+  /**
+   * @brief Returns the configured queue depth.
+   */
+  size_t queueDepth() const { return depth; }
+
+  /**
+   * @brief Creates an asynchronous queue whose completed requests are
+   * accounted by this context. Each merge or partitioning pass uses its
+   * own queue.
+   */
+  std::unique_ptr<IoQueue> createQueue();
+
+  /**
+   * @brief Accounts a read served outside open(), e.g. from a stream.
+   * @param offset The byte offset of the transfer, for block counting.
+   * @param bytes The bytes transferred; zero is not a request.
+   */
+  void recordRead(size_t offset, size_t bytes);
+
+  /**
+   * @brief Accounts a write served outside open(), e.g. to a pipe.
+   * @param offset The byte offset of the transfer, for block counting.
+   * @param bytes The bytes transferred; zero is not a request.
+   */
+  void recordWrite(size_t offset, size_t bytes);
+
+  /**
+   * @brief Returns the counters accumulated since the last reset().
+   */
+  IoStats stats() const;
+
+  /**
+   * @brief Zeroes the counters; the engines call it when a sort starts.
+   */
+  void reset();
+
+  /**
+   * @brief Returns the context of the free functions in file_handler.h.
+   */
+  static IoContext& global();
+
+ private:
+  std::shared_ptr<BlockDevice> blockDevice;
+  size_t depth = DEFAULT_QUEUE_DEPTH;
+  IoQueueKind queueKind = IoQueueKind::Auto;
+  std::atomic<size_t> readRequests{0};
+  std::atomic<size_t> writeRequests{0};
+  std::atomic<size_t> bytesRead{0};
+  std::atomic<size_t> bytesWritten{0};
+  std::atomic<size_t> blocksRead{0};
+  std::atomic<size_t> blocksWritten{0};
+};
+
+/**
+ * @brief Prints the counters in human-readable form.
+ */
+std::ostream& operator<<(std::ostream& out, const IoStats& stats);
+
+#endif  // IO_CONTEXT_H
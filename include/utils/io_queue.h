@@ -0,0 +1,162 @@
+#ifndef IO_QUEUE_H
+#define IO_QUEUE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/block_device.h"
+
+class IoContext;
+
+/**
+ * @brief Backends of IoQueue. Auto uses io_uring when the kernel allows it
+ * and the thread pool otherwise.
+ */
+enum class IoQueueKind { Auto, Uring, ThreadPool };
+
+/**
+ * @brief Requests an IoQueue keeps in flight unless configured otherwise.
+ */
+constexpr size_t DEFAULT_QUEUE_DEPTH = 8;
+
+/**
+ * @brief Asynchronous positional reads and writes with a bounded number of
+ * requests in flight.
+ *
+ * Requests are queued by read() and write() and issued together by
+ * submit(), so several run refills or partition flushes cost one system
+ * call on io_uring. Once depth requests are in flight, queueing another one
+ * first waits for an earlier one to complete. A queue is used by one
+ * thread; its buffers must stay valid until their ticket is waited for.
+ */
+class IoQueue {
+ public:
+  virtual ~IoQueue() = default;
+
+  IoQueue(const IoQueue&) = delete;
+  IoQueue& operator=(const IoQueue&) = delete;
+
+  /**
+   * @brief Queues a read of bytes bytes at offset into dest.
+   * @return The ticket to pass to wait().
+   */
+  size_t read(BlockFile& file, size_t offset, void* dest, size_t bytes);
+
+  /**
+   * @brief Queues a write of bytes bytes from src at offset.
+   * @return The ticket to pass to wait().
+   */
+  size_t write(BlockFile& file, size_t offset, const void* src,
+               size_t bytes);
+
+  /**
+   * @brief Issues every queued request as one batch.
+   */
+  virtual void submit() = 0;
+
+  /**
+   * @brief Blocks until a request completes, issuing it first if needed.
+   * Every ticket must be waited for exactly once.
+   * @param ticket The value returned by read() or write().
+   * @return The bytes transferred; fewer than requested only for a read
+   * that reaches the end of file. Throws std::runtime_error on failure.
+   */
+  size_t wait(size_t ticket);
+
+  /**
+   * @brief Pre-maps memory that later requests read into or write from.
+   * Only call it with nothing in flight; it replaces earlier buffers.
+   * @param buffers The start and size of each region.
+   * @return False if the backend keeps using plain requests.
+   */
+  virtual bool registerBuffers(
+      const std::vector<std::pair<void*, size_t>>& buffers);
+
+  /**
+   * @brief Pre-registers files that later requests use, saving a file
+   * table lookup per request. Only call it with nothing in flight.
+   * @param files The files.
+   * @return False if the backend keeps using plain descriptors.
+   */
+  virtual bool registerFiles(const std::vector<BlockFile*>& files);
+
+  /**
+   * @brief Returns the maximum number of requests in flight.
+   */
+  size_t depth() const { return queueDepth; }
+
+  /**
+   * @brief Returns a short name of the backend, for reports.
+   */
+  virtual std::string name() const = 0;
+
+  /**
+   * @brief Creates a queue.
+   * @param depth The maximum number of requests in flight, at least 1.
+   * @param kind The backend; Uring falls back to ThreadPool as Auto does.
+   * @param io The context that accounts completed requests, or null.
+   */
+  static std::unique_ptr<IoQueue> create(size_t depth,
+                                         IoQueueKind kind = IoQueueKind::Auto,
+                                         IoContext* io = nullptr);
+
+ protected:
+  /**
+   * @brief One positional transfer.
+   */
+  struct Request {
+    BlockFile* file;
+    size_t offset;
+    void* data;
+    size_t bytes;
+    bool write;
+  };
+
+  IoQueue(size_t depth, IoContext* io);
+
+  /**
+   * @brief Takes ownership of a request; it is issued by submit() at the
+   * latest. Called with fewer than depth() requests queued or in flight.
+   */
+  virtual void enqueue(size_t ticket, const Request& request) = 0;
+
+  /**
+   * @brief Waits for one request to complete and frees its slot, so that
+   * another one can be queued.
+   */
+  virtual void waitAny() = 0;
+
+  /**
+   * @brief Blocks until the request completes and returns the bytes it
+   * transferred, finishing short transfers synchronously.
+   */
+  virtual size_t complete(size_t ticket) = 0;
+
+  /**
+   * @brief Returns the number of requests queued or in flight.
+   */
+  virtual size_t outstanding() const = 0;
+
+  /**
+   * @brief Finishes a transfer the backend cut short, with the file's own
+   * synchronous calls.
+   * @param request The original request.
+   * @param done The bytes already transferred.
+   * @return The total bytes transferred.
+   */
+  static size_t finish(const Request& request, size_t done);
+
+ private:
+  size_t submitRequest(const Request& request);
+
+  size_t queueDepth;
+  IoContext* io;
+  size_t nextTicket = 0;
+  std::unordered_map<size_t, Request> requests;
+};
+
+#endif  // IO_QUEUE_H
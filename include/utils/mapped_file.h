@@ -0,0 +1,80 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief How a MappedFile is expected to be read, passed to the kernel as
+ * a madvise hint.
+ */
+enum class AccessPattern { Normal, Sequential, Random };
+
+/**
+ * @brief Read-only memory mapping of a binary file of 64-bit integers.
+ *
+ * The keys are read in place: pages are faulted in from the page cache on
+ * first touch and can be reclaimed again, so mapping a dataset neither
+ * copies it nor adds to the anonymous memory of the process. Mappings of
+ * at least one huge page are placed on a huge-page boundary and offered
+ * transparent huge pages where the kernel supports them for files.
+ */
+class MappedFile {
+ public:
+  /**
+   * @brief Maps a file. Throws std::runtime_error if it cannot be opened or
+   * mapped.
+   * @param path The file to map.
+   * @param pattern The initial access hint.
+   */
+  explicit MappedFile(const std::string& path,
+                      AccessPattern pattern = AccessPattern::Sequential);
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * @brief Returns the keys, or null for an empty file.
+   */
+  const int64_t* data() const { return keys; }
+
+  /**
+   * @brief Returns the number of whole keys in the file.
+   */
+  size_t size() const { return length / sizeof(int64_t); }
+
+  /**
+   * @brief Returns the size of the file in bytes.
+   */
+  size_t bytes() const { return length; }
+
+  /**
+   * @brief Replaces the access hint of the whole mapping.
+   */
+  void advise(AccessPattern pattern);
+
+  /**
+   * @brief Asks the kernel to start reading keys that will be needed soon.
+   * @param offset The first key.
+   * @param count The number of keys.
+   */
+  void willNeed(size_t offset, size_t count);
+
+  /**
+   * @brief Returns whether the kernel accepted huge pages for the mapping.
+   */
+  bool hugePages() const { return huge; }
+
+ private:
+  void unmap();
+
+  const int64_t* keys = nullptr;
+  size_t length = 0;
+  bool huge = false;
+};
+
+#endif  // MAPPED_FILE_H
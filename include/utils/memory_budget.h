@@ -0,0 +1,65 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * @brief Byte budget shared by concurrent tasks of one sort.
+ *
+ * Tasks reserve the memory they are about to allocate and block until it is
+ * available, so the total held at any time never exceeds the budget.
+ * Requests larger than the whole budget are clamped to it and therefore run
+ * alone.
+ */
+class MemoryBudget {
+ public:
+  /**
+   * @brief RAII handle for reserved bytes, released on destruction.
+   */
+  class Reservation {
+   public:
+    Reservation(MemoryBudget& budget, size_t bytes);
+    ~Reservation();
+
+    Reservation(const Reservation&) = delete;
+    Reservation& operator=(const Reservation&) = delete;
+
+    /**
+     * @brief Returns the bytes to the budget before destruction.
+     */
+    void release();
+
+   private:
+    MemoryBudget& budget;
+    size_t bytes;
+  };
+
+  /**
+   * @brief Creates a budget.
+   * @param totalBytes The number of bytes that may be held at once.
+   */
+  explicit MemoryBudget(size_t totalBytes);
+
+  /**
+   * @brief Blocks until the bytes are available and reserves them.
+   * @param bytes The bytes requested.
+   * @return The bytes actually reserved, at most the whole budget.
+   */
+  size_t acquire(size_t bytes);
+
+  /**
+   * @brief Returns bytes obtained from acquire().
+   * @param bytes The value acquire() returned.
+   */
+  void release(size_t bytes);
+
+ private:
+  size_t totalBytes;
+  size_t available;
+  std::mutex mutex;
+  std::condition_variable released;
+};
+
+#endif  // MEMORY_BUDGET_H
@@ -0,0 +1,150 @@
+#ifndef PARTITION_WRITER_H
+#define PARTITION_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/io_context.h"
+#include "utils/io_queue.h"
+#include "utils/sort_parameters.h"
+
+/**
+ * @brief Append-only writers for the partition files of one distribution
+ * pass.
+ *
+ * Every partition file is opened once and stays open until close(). Each
+ * partition fills its own buffer; a full buffer is handed to a write-behind
+ * thread and replaced by a free one, so the classifying thread only waits
+ * when every spare buffer is still being written. The write-behind thread
+ * queues all buffers handed over since its last batch and submits them
+ * together on an IoQueue: one system call on io_uring, one pwrite per
+ * buffer on the thread-pool backend. Buffers are not merged into vectored
+ * writes, so each stays one accounted write request and the counts match
+ * explain() however the batches fall. Buffers come from
+ * AlignedBufferPool::global() and return there on close(), so later passes
+ * reuse them.
+ *
+ * A set is filled by one thread at a time; different partitions of one
+ * call to extend() may be written concurrently.
+ */
+class PartitionWriterSet {
+ public:
+  /**
+   * @brief Creates the files, empty, and starts the write-behind thread.
+   * @param io The context that opens and accounts the files.
+   * @param files The path of each partition file.
+   * @param capacity The elements a partition buffers before it is written.
+   * @param spareBuffers The buffers beyond one per partition, at least 1.
+   */
+  PartitionWriterSet(IoContext& io, const std::vector<std::string>& files,
+                     size_t capacity,
+                     size_t spareBuffers = WRITE_BEHIND_BUFFERS);
+
+  /**
+   * @brief Stops the write-behind thread. Buffers not yet flushed are
+   * discarded; call close() to keep them.
+   */
+  ~PartitionWriterSet();
+
+  PartitionWriterSet(const PartitionWriterSet&) = delete;
+  PartitionWriterSet& operator=(const PartitionWriterSet&) = delete;
+
+  /**
+   * @brief Returns the number of partitions.
+   */
+  size_t count() const { return buffers.size(); }
+
+  /**
+   * @brief Returns the elements a partition buffers before it is written.
+   */
+  size_t capacity() const { return bufferCapacity; }
+
+  /**
+   * @brief Returns the elements buffered for a partition.
+   */
+  size_t size(size_t partition) const { return fills[partition]; }
+
+  /**
+   * @brief Returns the buffer of a partition. It is replaced by flush().
+   */
+  int64_t* buffer(size_t partition) { return buffers[partition]; }
+
+  /**
+   * @brief Appends a key to a partition, flushing the buffer once full.
+   */
+  void push(size_t partition, int64_t key) {
+    buffers[partition][fills[partition]++] = key;
+    if (fills[partition] == bufferCapacity) {
+      flush(partition);
+    }
+  }
+
+  /**
+   * @brief Grows a partition by count elements that the caller writes
+   * into buffer(). The buffer must have room for them.
+   * @return The position of the first new element in the buffer.
+   */
+  size_t extend(size_t partition, size_t count);
+
+  /**
+   * @brief Hands the buffer of a partition to the write-behind thread.
+   * Empty buffers are skipped. Rethrows an earlier write error.
+   */
+  void flush(size_t partition);
+
+  /**
+   * @brief Hands several buffers over together, so they are written as one
+   * submission.
+   * @param partitions The partitions to flush; empty buffers are skipped.
+   */
+  void flush(const std::vector<size_t>& partitions);
+
+  /**
+   * @brief Writes every remaining buffer, waits for all writes and closes
+   * the files. Rethrows the first write error. Later calls do nothing.
+   */
+  void close();
+
+ private:
+  /**
+   * @brief One full buffer on its way to a partition file.
+   */
+  struct PendingWrite {
+    BlockFile* file;
+    size_t offset;
+    int64_t* data;
+    size_t bytes;
+  };
+
+  void handOver(const std::vector<size_t>& partitions, bool replace);
+  void writeLoop();
+  void stop();
+  void releaseBuffers();
+  void throwIfFailed();
+
+  std::vector<IoContext::File> handles;
+  std::vector<int64_t*> buffers;
+  std::vector<size_t> fills;
+  std::vector<size_t> written;
+  size_t bufferCapacity;
+
+  std::vector<int64_t*> allBuffers;
+  std::vector<int64_t*> freeBuffers;
+  std::vector<PendingWrite> pending;
+  std::unique_ptr<IoQueue> queue;
+  std::exception_ptr error;
+  bool stopping = false;
+  std::mutex mutex;
+  std::condition_variable work;
+  std::condition_variable recycled;
+  std::thread writer;
+};
+
+#endif  // PARTITION_WRITER_H
@@ -0,0 +1,148 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "utils/io_context.h"
+
+/**
+ * @brief Mergeable streaming quantile sketch for 64-bit keys (KLL).
+ *
+ * Keys are kept in a stack of compactors; level h holds keys of weight 2^h.
+ * When the sketch is full, the lowest full level is sorted and every other
+ * key, starting at a random offset, is promoted to the next level. Capacities
+ * shrink geometrically below the top level, so the sketch retains
+ * O(k log(n / k)) keys for n updates and answers rank queries within
+ * normalizedRankError(k) * n of the true rank with 99% confidence. While
+ * fewer than k keys have been added, answers are exact.
+ *
+ * A sample gap above one makes update() keep one key per gap on average,
+ * at random gaps, so summarizing a long stream costs a counter decrement
+ * per key; the sampling error adds to the rank error.
+ */
+class QuantileSketch {
+ public:
+  static constexpr size_t DEFAULT_K = 256;
+
+  /**
+   * @brief Creates an empty sketch.
+   * @param k The accuracy parameter; larger is more accurate.
+   * @param sampleGap The average number of keys per key kept.
+   */
+  explicit QuantileSketch(size_t k = DEFAULT_K, size_t sampleGap = 1);
+
+  /**
+   * @brief Adds a key.
+   */
+  void update(int64_t key) {
+    if (key < minKey) minKey = key;
+    if (key > maxKey) maxKey = key;
+    n++;
+    if (--countdown == 0) {
+      countdown = nextGap();
+      insert(key);
+    }
+  }
+
+  /**
+   * @brief Adds n keys.
+   */
+  void update(const int64_t* keys, size_t n);
+
+  /**
+   * @brief Adds every key summarized by another sketch.
+   * @param other A sketch of a disjoint set of keys, with the same sample
+   * gap.
+   */
+  void merge(const QuantileSketch& other);
+
+  /**
+   * @brief Returns the number of keys added.
+   */
+  size_t count() const;
+
+  /**
+   * @brief Returns true if no key was added.
+   */
+  bool empty() const;
+
+  /**
+   * @brief Returns the number of keys retained.
+   */
+  size_t retained() const;
+
+  /**
+   * @brief Returns the smallest and largest key added.
+   */
+  int64_t min() const;
+  int64_t max() const;
+
+  /**
+   * @brief Estimates the number of keys smaller than key.
+   */
+  size_t rank(int64_t key) const;
+
+  /**
+   * @brief Returns a key whose rank is approximately q * count().
+   * @param q The quantile, in [0, 1].
+   */
+  int64_t quantile(double q) const;
+
+  /**
+   * @brief Returns the parts - 1 keys at quantiles i / parts, in order and
+   * possibly repeated.
+   * @param parts The number of ranges the splitters define.
+   */
+  std::vector<int64_t> splitters(size_t parts) const;
+
+  /**
+   * @brief Returns the rank error bound, as a fraction of count(), that
+   * holds with 99% confidence for the given k.
+   */
+  static double normalizedRankError(size_t k);
+
+  /**
+   * @brief Sketches a binary file of 64-bit integers in a single pass.
+   * @param path The file to read.
+   * @param k The accuracy parameter.
+   * @param io The context that accounts the reads.
+   */
+  static QuantileSketch fromFile(const std::string& path,
+                                 size_t k = DEFAULT_K,
+                                 IoContext& io = IoContext::global());
+
+  /**
+   * @brief Prints count, extremes and the given number of evenly spaced
+   * quantiles.
+   * @param out The stream to print to.
+   * @param parts The number of quantile ranges to report.
+   */
+  void printSummary(std::ostream& out, size_t parts = 10) const;
+
+ private:
+  void insert(int64_t key);
+  size_t nextGap();
+  size_t levelCapacity(size_t level) const;
+  size_t totalCapacity() const;
+  void compress();
+  void compact(size_t level);
+  std::vector<std::pair<int64_t, uint64_t>> weightedKeys() const;
+
+  size_t k;
+  size_t sampleGap;
+  size_t countdown = 1;
+  size_t n = 0;
+  uint64_t keptWeight = 0;
+  size_t retainedKeys = 0;
+  size_t capacity = 0;
+  int64_t minKey;
+  int64_t maxKey;
+  uint64_t randomState;
+  std::vector<std::vector<int64_t>> levels;
+};
+
+#endif  // QUANTILE_SKETCH_H
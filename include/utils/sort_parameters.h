@@ -28,14 +28,56 @@ inline size_t mbToElementCount(size_t mbSize) {
 }
 
 /**
- * Calculate the optimal arity (fan-in/fan-out) for external sorting algorithms
- * based on available memory and buffer size.
+ * Elements of one initial MergeSort run under a memory budget.
  *
- * @param M Maximum memory size in bytes that can be used
- * @param bufferElements Number of elements that can fit in a buffer
- * @return The calculated optimal arity
+ * A run takes half of M; the other half is left to the radix scratch of
+ * run formation. The engine, its explain() and the planner all size runs
+ * with this function.
+ *
+ * @param M Maximum memory size in bytes
+ * @return Number of 64-bit integers per run, at least 1
+ */
+inline size_t mergeRunElements(size_t M) {
+  return std::max(M / (2 * INT64_SIZE), size_t(1));
+}
+
+/**
+ * Buffers a PartitionWriterSet keeps beyond one per partition, so that
+ * full buffers can be written while the partitions keep filling.
+ */
+constexpr size_t WRITE_BEHIND_BUFFERS = 4;
+
+/**
+ * Buffers of one QuickSort or RadixSort distribution pass.
+ *
+ * One per partition, the write-behind spares and the read buffer. A
+ * parallel pass also keeps one 32-bit partition index per element of the
+ * read block, which is counted as one more buffer.
+ *
+ * @param partitions Partitions the pass writes
+ * @param threads Threads classifying the pass
+ * @return Number of buffers of distributionBufferElements() elements
  */
-size_t calculateOptimalArity(size_t M, size_t bufferElements);
+inline size_t distributionBuffers(size_t partitions, size_t threads) {
+  return partitions + WRITE_BEHIND_BUFFERS + (threads > 1 ? 2 : 1);
+}
+
+/**
+ * Elements per buffer of one distribution pass: 80% of M split among
+ * distributionBuffers(), at least 1000. The engines, their explain() and
+ * the planner all size buffers with this function; the engines then round
+ * it down to whole blocks with IoContext::alignedCount.
+ *
+ * @param M Maximum memory size in bytes
+ * @param partitions Partitions the pass writes
+ * @param threads Threads classifying the pass
+ * @return Number of 64-bit integers per buffer
+ */
+inline size_t distributionBufferElements(size_t M, size_t partitions,
+                                         size_t threads) {
+  size_t buffers = distributionBuffers(partitions, threads);
+  return std::max(size_t(1000), size_t(M * 0.8) / (buffers * INT64_SIZE));
+}
 
 /**
  * Calculate the optimal buffer size for external sorting.
@@ -43,9 +85,12 @@ size_t calculateOptimalArity(size_t M, size_t bufferElements);
  * @param M Maximum memory size in bytes
  * @param totalElements Total number of elements in the dataset
  * @param arity The merge arity being used
+ * @param buffersPerStream Buffers held by each input run and by the output;
+ * 2 when reads and writes are double-buffered
  * @return Optimal buffer size in number of elements
  */
-size_t calculateOptimalBufferSize(size_t M, size_t totalElements, size_t arity);
+size_t calculateOptimalBufferSize(size_t M, size_t totalElements, size_t arity,
+                                  size_t buffersPerStream = 1);
 
 /**
  * Find the optimal arity using binary search to determine the best performance.
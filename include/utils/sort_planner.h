@@ -0,0 +1,165 @@
+#ifndef SORT_PLANNER_H
+#define SORT_PLANNER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief Machine constants used to predict the cost of an external sort.
+ *
+ * I/O is modelled as a fixed latency per request plus a sequential transfer
+ * time; CPU work as a cost per element for each pass over the data.
+ */
+struct CostModel {
+  double readBandwidth;       ///< Sequential read bandwidth in bytes/s
+  double writeBandwidth;      ///< Sequential write bandwidth in bytes/s
+  double requestLatency;      ///< Fixed cost of one I/O request in seconds
+  double sortCost;            ///< In-memory sort, seconds per element
+  double mergeCost;           ///< Loser tree, seconds per element and level
+  double classifyCost;        ///< Splitter tree, seconds per element and level
+  double scatterCost;         ///< Append to a bucket, seconds per element
+
+  /**
+   * @brief Returns conservative constants for a commodity SSD, used when
+   * calibration is not possible.
+   */
+  static CostModel defaults();
+
+  /**
+   * @brief Measures the constants of this machine in a few seconds.
+   *
+   * Writes and reads back a 32 MB file in dir in 1 MB requests, with the
+   * page cache dropped in between, times random 4 KB reads for the request
+   * latency, and times the sort, merge and partition kernels on 1M keys.
+   *
+   * @param dir Directory for the scratch file, on the disk that will be used.
+   * @return The measured model.
+   */
+  static CostModel calibrate(const std::string& dir);
+
+  /**
+   * @brief Loads a model saved by save().
+   * @param path The cache file.
+   * @param model Receives the model.
+   * @return False if the file is missing, malformed or from another host.
+   */
+  static bool load(const std::string& path, CostModel& model);
+
+  /**
+   * @brief Saves the model, tagged with the host name.
+   * @param path The cache file.
+   */
+  void save(const std::string& path) const;
+
+  /**
+   * @brief Returns the cached model of this machine, calibrating and caching
+   * it on first use.
+   * @param cachePath The cache file, DEFAULT_CACHE_PATH by default.
+   */
+  static CostModel forMachine(
+      const std::string& cachePath = DEFAULT_CACHE_PATH);
+
+  static constexpr const char* DEFAULT_CACHE_PATH = "data/cost_model.txt";
+};
+
+/**
+ * @brief The external sort engines the planner can tune.
+ */
+enum class SortEngine { MergeSort, QuickSort, RadixSort };
+
+/**
+ * @brief Largest arity the planner considers.
+ */
+constexpr size_t MAX_PLAN_ARITY = 4096;
+
+/**
+ * @brief Parameters chosen by planSort and their predicted cost.
+ */
+struct SortPlan {
+  size_t arity;             ///< Merge fan-in or distribution fan-out
+  size_t bufferElements;    ///< Elements per stream buffer
+  size_t passes;            ///< Passes over the data, run formation included
+  double ioSeconds;         ///< Predicted I/O time
+  double cpuSeconds;        ///< Predicted CPU time
+
+  /**
+   * @brief Returns the predicted total time.
+   */
+  double seconds() const { return ioSeconds + cpuSeconds; }
+};
+
+/**
+ * @brief Predicts the cost of sorting with a given arity.
+ *
+ * MergeSort forms runs of mergeRunElements(M) keys, half of M, and then
+ * merges them in ceil(log_a(runs)) passes with double-buffered streams.
+ * The distribution engines split the input in ceil(log_a(N/(M/8))) passes
+ * until partitions fit in memory, then sort each partition in one more
+ * pass, with the buffers of distributionBufferElements(). RadixSort rounds
+ * the arity down to a power of two, as bucketBits does, and always runs on
+ * one thread.
+ *
+ * @param engine The engine.
+ * @param N Number of 64-bit keys.
+ * @param M Memory budget in bytes.
+ * @param arity The arity to evaluate, at least 2.
+ * @param model The machine constants.
+ * @param threads The threads of a QuickSort distribution pass.
+ */
+SortPlan evaluatePlan(SortEngine engine, size_t N, size_t M, size_t arity,
+                      const CostModel& model, size_t threads = 1);
+
+/**
+ * @brief Chooses the arity with the lowest predicted cost.
+ *
+ * Every arity whose stream buffers still hold a whole disk block is
+ * evaluated, up to MAX_PLAN_ARITY.
+ *
+ * @param engine The engine.
+ * @param N Number of 64-bit keys.
+ * @param M Memory budget in bytes.
+ * @param model The machine constants.
+ * @param threads The threads of a QuickSort distribution pass.
+ */
+SortPlan planSort(SortEngine engine, size_t N, size_t M,
+                  const CostModel& model, size_t threads = 1);
+
+/**
+ * @brief Dry-run prediction of an external sort, in the same units as
+ * disk_read_count and disk_write_count: one count per I/O request.
+ */
+struct SortExplanation {
+  size_t runs;             ///< Initial runs, or partitions of the first pass
+  size_t passes;           ///< Merge or partitioning levels, deepest path
+  size_t diskReads;        ///< Predicted disk_read_count
+  size_t diskWrites;       ///< Predicted disk_write_count
+  size_t peakTempBytes;    ///< High-water mark of temporary files
+  size_t peakBufferBytes;  ///< Largest buffer memory held at once
+};
+
+/**
+ * @brief Prints the predicted counters next to the current disk counters,
+ * with the relative error of each.
+ * @param out The stream to print to.
+ * @param predicted The prediction made before the sort.
+ */
+void compareWithCounters(std::ostream& out, const SortExplanation& predicted);
+
+/**
+ * @brief Prints a model in human-readable form.
+ */
+std::ostream& operator<<(std::ostream& out, const CostModel& model);
+
+/**
+ * @brief Prints a plan in human-readable form.
+ */
+std::ostream& operator<<(std::ostream& out, const SortPlan& plan);
+
+/**
+ * @brief Prints an explanation in human-readable form.
+ */
+std::ostream& operator<<(std::ostream& out,
+                         const SortExplanation& explanation);
+
+#endif  // SORT_PLANNER_H
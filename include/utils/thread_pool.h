@@ -0,0 +1,124 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads executing queued tasks in FIFO
+ * order.
+ *
+ * Tasks submitted to a single-thread pool run strictly one after another,
+ * which the sorting engines rely on for background I/O on shared streams.
+ * The destructor finishes every queued task before joining the workers.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @brief Starts the worker threads.
+   * @param threadCount The number of workers, at least one.
+   */
+  explicit ThreadPool(size_t threadCount);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * @brief Queues a task for execution.
+   * @param task The task to run.
+   * @return A future that becomes ready when the task finishes and rethrows
+   * any exception the task raised.
+   */
+  std::future<void> submit(std::function<void()> task);
+
+  /**
+   * @brief Returns the number of worker threads.
+   */
+  size_t size() const;
+
+ private:
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::queue<std::packaged_task<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+};
+
+/**
+ * @brief Tracks a dynamic set of tasks that may spawn further tasks.
+ *
+ * With a pool, run() queues the task and returns immediately; without one
+ * it runs the task inline, so recursive algorithms keep a single code path
+ * for their sequential mode. Tasks never wait on each other, which keeps a
+ * fixed-size pool free of deadlocks.
+ */
+class TaskGroup {
+ public:
+  /**
+   * @brief Creates an empty group.
+   * @param pool The pool that runs the tasks, or nullptr to run them inline.
+   */
+  explicit TaskGroup(ThreadPool* pool);
+
+  /**
+   * @brief Waits for every task still running, discarding their errors.
+   */
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  /**
+   * @brief Runs a task as part of the group.
+   * @param task The task; it may call run() again.
+   */
+  void run(std::function<void()> task);
+
+  /**
+   * @brief Blocks until every task of the group, including those spawned by
+   * other tasks, has finished, then rethrows the first error raised.
+   */
+  void wait();
+
+  /**
+   * @brief Returns the pool that runs the tasks, or nullptr.
+   */
+  ThreadPool* getPool() const;
+
+ private:
+  void finish(std::exception_ptr error);
+
+  ThreadPool* pool;
+  size_t pending = 0;
+  std::exception_ptr firstError;
+  std::mutex mutex;
+  std::condition_variable idle;
+};
+
+/**
+ * @brief Calls body(i) for every i in [0, count), spread over the pool.
+ *
+ * The calling thread claims indices too and only waits for indices already
+ * being processed, so it is safe to call from inside a pool task even when
+ * every worker is busy. Without a pool the loop runs inline.
+ *
+ * @param pool The pool that helps with the loop, or nullptr.
+ * @param count The number of indices.
+ * @param body The loop body; the first exception it throws is rethrown.
+ */
+void parallelFor(ThreadPool* pool, size_t count,
+                 const std::function<void(size_t)>& body);
+
+#endif  // THREAD_POOL_H
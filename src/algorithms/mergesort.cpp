@@ -1,90 +1,279 @@
 #include "algorithms/mergesort.h"
 
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <filesystem>
-#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <queue>
 
+#include "algorithms/bottom_up_merge_sort.h"
+#include "algorithms/loser_tree.h"
+#include "algorithms/lsd_radix_sort.h"
 #include "utils/file_handler.h"
+#include "utils/io_queue.h"
 #include "utils/sort_parameters.h"
+#include "utils/sort_planner.h"
+#include "utils/thread_pool.h"
+
+void MergeSort::sort(std::vector<int>& arr) {
+  std::vector<int> buffer(arr.size());
+  bottomUpMergeSort(arr.data(), arr.size(), buffer.data());
+}
+
+void MergeSort::sort(std::vector<int64_t>& arr) {
+  std::vector<int64_t> buffer(arr.size());
+  bottomUpMergeSort(arr.data(), arr.size(), buffer.data());
+}
+
+void MergeSort::setRunGeneration(RunGeneration mode) { runGeneration = mode; }
+
+void MergeSort::setTempDirectory(const std::string& dir) {
+  tempDirectory = dir;
+}
+
+void MergeSort::setThreadCount(size_t threads) {
+  threadCount = std::max(size_t(1), threads);
+}
+
+void MergeSort::setBlockDevice(std::shared_ptr<BlockDevice> device) {
+  io.setDevice(std::move(device));
+}
+
+void MergeSort::setIoQueue(size_t depth, IoQueueKind kind) {
+  io.setQueue(depth, kind);
+}
 
-void MergeSort::merge(std::vector<int>& arr, int left, int mid, int right) {
-  int n1 = mid - left + 1;
-  int n2 = right - mid;
+std::vector<std::string> MergeSort::createInitialRuns(
+    const int64_t* data, size_t n, size_t runSize,
+    const std::string& tempDir) {
+  size_t next = 0;
+  RunSource source = [data, n, &next](int64_t* dest, size_t count) {
+    size_t available = std::min(count, n - next);
+    std::copy(data + next, data + next + available, dest);
+    next += available;
+    return available;
+  };
+
+  return generateRuns(source, runSize, tempDir);
+}
 
-  std::vector<int> L(n1), R(n2);
+std::vector<std::string> MergeSort::createInitialRunsFromFile(
+    const std::string& inputPath, size_t runSize,
+    const std::string& tempDir) {
+  IoContext::File input = io.open(inputPath, OpenMode::Read);
+  size_t position = 0;
+
+  RunSource source = [&input, &position](int64_t* dest, size_t count) {
+    size_t elementsRead =
+        input.read(position * sizeof(int64_t), dest, count * sizeof(int64_t)) /
+        sizeof(int64_t);
+    position += elementsRead;
+    return elementsRead;
+  };
+
+  return generateRuns(source, runSize, tempDir);
+}
 
-  for (int i = 0; i < n1; i++) {
-    L[i] = arr[left + i];
+std::vector<std::string> MergeSort::generateRuns(const RunSource& source,
+                                                 size_t runSize,
+                                                 const std::string& tempDir) {
+  if (runGeneration == RunGeneration::ReplacementSelection) {
+    return generateReplacementSelectionRuns(source, runSize, tempDir);
   }
-  for (int j = 0; j < n2; j++) {
-    R[j] = arr[mid + 1 + j];
+  return generateFixedSizeRuns(source, runSize, tempDir);
+}
+
+std::vector<std::string> MergeSort::generateFixedSizeRuns(
+    const RunSource& source, size_t runSize, const std::string& tempDir) {
+  std::vector<std::string> runFiles;
+  AlignedVector<int64_t> run;
+
+  // With several threads the run is sorted as independent slices that are
+  // merged while the run file is written; the merge output buffer comes out
+  // of the same run budget.
+  bool parallel = threadCount > 1 && runSize >= threadCount * 1024;
+  size_t ioSize = parallel ? std::max(size_t(1), runSize / 16) : 0;
+  ioSize = io.alignedCount(ioSize, sizeof(int64_t));
+  size_t runCapacity = runSize - ioSize;
+  std::unique_ptr<ThreadPool> pool;
+  if (parallel) {
+    pool = std::make_unique<ThreadPool>(threadCount);
   }
 
-  int i = 0;
-  int j = 0;
-  int k = left;
+  // Radix sort scratch, reused across runs. Runs are mergeRunElements(M)
+  // long, half of M, so the run buffer and this scratch together stay
+  // within M; run formation and merging never overlap.
+  std::vector<int64_t> scratch;
+
+  while (true) {
+    run.resize(runCapacity);
+    size_t elementsRead = source(run.data(), runCapacity);
+    if (elementsRead == 0) break;
 
-  while (i < n1 && j < n2) {
-    if (L[i] <= R[j]) {
-      arr[k] = L[i];
-      i++;
+    run.resize(elementsRead);
+
+    std::string runFile =
+        tempDir + "/run_" + std::to_string(runFiles.size()) + ".bin";
+
+    if (parallel) {
+      scratch.resize(std::max(scratch.size(), run.size()));
+      writeParallelSortedRun(run, scratch.data(), runFile, ioSize, *pool);
     } else {
-      arr[k] = R[j];
-      j++;
+      sortKeys(run.data(), run.size(), scratch);
+      io.open(runFile, OpenMode::Write)
+          .write(0, run.data(), run.size() * sizeof(int64_t));
     }
-    k++;
-  }
 
-  while (i < n1) {
-    arr[k] = L[i];
-    i++;
-    k++;
+    runFiles.push_back(runFile);
   }
 
-  while (j < n2) {
-    arr[k] = R[j];
-    j++;
-    k++;
-  }
+  return runFiles;
 }
 
-void MergeSort::mergeSort(std::vector<int>& arr, int left, int right) {
-  if (left < right) {
-    int mid = left + (right - left) / 2;
+void MergeSort::writeParallelSortedRun(AlignedVector<int64_t>& run,
+                                       int64_t* scratch,
+                                       const std::string& runFile,
+                                       size_t ioSize, ThreadPool& pool) {
+  size_t sliceCount = pool.size();
+  size_t sliceSize = (run.size() + sliceCount - 1) / sliceCount;
+
+  std::vector<std::pair<const int64_t*, const int64_t*>> slices;
+  std::vector<std::future<void>> sorted;
+  for (size_t start = 0; start < run.size(); start += sliceSize) {
+    int64_t* begin = run.data() + start;
+    int64_t* end = run.data() + std::min(start + sliceSize, run.size());
+    int64_t* sliceScratch = scratch + start;
+    slices.push_back({begin, end});
+    sorted.push_back(pool.submit([begin, end, sliceScratch] {
+      sortKeys(begin, static_cast<size_t>(end - begin), sliceScratch);
+    }));
+  }
+  for (auto& future : sorted) {
+    future.get();
+  }
 
-    mergeSort(arr, left, mid);
-    mergeSort(arr, mid + 1, right);
+  IoContext::File out = io.open(runFile, OpenMode::Write);
+  size_t written = 0;
 
-    merge(arr, left, mid, right);
+  LoserTree<int64_t> tree(slices.size());
+  for (size_t i = 0; i < slices.size(); i++) {
+    tree.setLeaf(i, *slices[i].first);
   }
-}
+  tree.build();
+
+  AlignedVector<int64_t> outputBuffer(ioSize);
+  size_t outputCount = 0;
+
+  auto flush = [&]() {
+    out.write(written * sizeof(int64_t), outputBuffer.data(),
+              outputCount * sizeof(int64_t));
+    written += outputCount;
+    outputCount = 0;
+  };
+
+  while (!tree.empty()) {
+    size_t slice = tree.winner();
+    outputBuffer[outputCount++] = tree.winnerKey();
+    if (outputCount == ioSize) {
+      flush();
+    }
 
-void MergeSort::sort(std::vector<int>& arr) {
-  if (!arr.empty()) {
-    mergeSort(arr, 0, arr.size() - 1);
+    if (++slices[slice].first != slices[slice].second) {
+      tree.replaceWinner(*slices[slice].first);
+    } else {
+      tree.removeWinner();
+    }
+  }
+  if (outputCount > 0) {
+    flush();
   }
 }
 
-std::vector<std::string> MergeSort::createInitialRuns(
-    const std::vector<int64_t>& arr, size_t runSize,
-    const std::string& tempDir) {
+std::vector<std::string> MergeSort::generateReplacementSelectionRuns(
+    const RunSource& source, size_t runSize, const std::string& tempDir) {
+  // The run budget is split between the selection heap and two small I/O
+  // buffers so the whole stage still uses runSize elements.
+  size_t ioSize =
+      io.alignedCount(std::max(size_t(1), runSize / 16), sizeof(int64_t));
+  size_t heapCapacity =
+      std::max(size_t(1), runSize - std::min(runSize, 2 * ioSize));
+
+  AlignedVector<int64_t> inputBuffer(ioSize);
+  size_t inputPos = 0;
+  size_t inputEnd = 0;
+  auto nextInput = [&](int64_t& value) {
+    if (inputPos == inputEnd) {
+      inputEnd = source(inputBuffer.data(), inputBuffer.size());
+      inputPos = 0;
+      if (inputEnd == 0) return false;
+    }
+    value = inputBuffer[inputPos++];
+    return true;
+  };
+
+  // heap[0, heapSize) holds the current run as a min-heap; heap[heapSize,
+  // filled) holds elements that are smaller than the last output and must
+  // wait for the next run.
+  std::vector<int64_t> heap(heapCapacity);
+  size_t filled = 0;
+  while (filled < heapCapacity && nextInput(heap[filled])) {
+    filled++;
+  }
+
   std::vector<std::string> runFiles;
-  size_t n = arr.size();
-  size_t runCount = (n + runSize - 1) / runSize;
+  AlignedVector<int64_t> outputBuffer;
+  outputBuffer.reserve(ioSize);
+  std::greater<int64_t> cmp;
+
+  while (filled > 0) {
+    std::string runFile =
+        tempDir + "/run_" + std::to_string(runFiles.size()) + ".bin";
+    IoContext::File out = io.open(runFile, OpenMode::Write);
+    size_t written = 0;
+
+    auto flush = [&]() {
+      out.write(written * sizeof(int64_t), outputBuffer.data(),
+                outputBuffer.size() * sizeof(int64_t));
+      written += outputBuffer.size();
+      outputBuffer.clear();
+    };
 
-  for (size_t i = 0; i < runCount; i++) {
-    size_t startIdx = i * runSize;
-    size_t endIdx = std::min(startIdx + runSize, n);
+    size_t heapSize = filled;
+    std::make_heap(heap.begin(), heap.begin() + heapSize, cmp);
 
-    std::vector<int64_t> run(arr.begin() + startIdx, arr.begin() + endIdx);
+    while (heapSize > 0) {
+      std::pop_heap(heap.begin(), heap.begin() + heapSize, cmp);
+      int64_t smallest = heap[heapSize - 1];
 
-    std::sort(run.begin(), run.end());
+      outputBuffer.push_back(smallest);
+      if (outputBuffer.size() >= ioSize) {
+        flush();
+      }
 
-    std::string runFile = tempDir + "/run_" + std::to_string(i) + ".bin";
-    writeInt64DataToFile(run, runFile);
+      int64_t value;
+      if (nextInput(value)) {
+        heap[heapSize - 1] = value;
+        if (value >= smallest) {
+          std::push_heap(heap.begin(), heap.begin() + heapSize, cmp);
+        } else {
+          heapSize--;
+        }
+      } else {
+        heap[heapSize - 1] = heap[filled - 1];
+        heapSize--;
+        filled--;
+      }
+    }
+
+    if (!outputBuffer.empty()) {
+      flush();
+    }
 
     runFiles.push_back(runFile);
   }
@@ -92,182 +281,479 @@ std::vector<std::string> MergeSort::createInitialRuns(
   return runFiles;
 }
 
-struct HeapNode {
-  int64_t value;
-  size_t runIndex;
-  size_t posInRun;
+std::vector<MergeStep> MergeSort::planMerges(
+    const std::vector<size_t>& runSizes, size_t a) {
+  std::vector<MergeStep> plan;
+  size_t K = runSizes.size();
+  if (K <= 1) return plan;
+
+  a = std::max(size_t(2), a);
+
+  // Min-heap of (elements, run index); intermediate results get the next
+  // index after the initial runs.
+  using Entry = std::pair<size_t, size_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+  std::vector<size_t> levels(K, 0);
+  for (size_t i = 0; i < K; i++) {
+    heap.push({runSizes[i], i});
+  }
+
+  // Padding with (a - 1 - (K - 1) % (a - 1)) empty dummy runs makes every
+  // merge full; the dummies are absorbed by a smaller first merge instead.
+  size_t firstFanIn = (K - 1) % (a - 1) + 1;
+  if (firstFanIn == 1) firstFanIn = a;
+
+  size_t fanIn = std::min(firstFanIn, K);
+  while (heap.size() > 1) {
+    MergeStep step;
+    step.elements = 0;
+    step.level = 0;
+    for (size_t i = 0; i < fanIn && !heap.empty(); i++) {
+      Entry entry = heap.top();
+      heap.pop();
+      step.inputs.push_back(entry.second);
+      step.elements += entry.first;
+      step.level = std::max(step.level, levels[entry.second] + 1);
+    }
+    step.output = K + plan.size();
+    levels.push_back(step.level);
+    heap.push({step.elements, step.output});
+    plan.push_back(step);
+
+    fanIn = a;
+  }
 
-  bool operator>(const HeapNode& other) const { return value > other.value; }
-};
+  return plan;
+}
 
 void MergeSort::mergeRuns(const std::vector<std::string>& runFiles,
                           const std::string& outputFile, size_t M, size_t a) {
+  mergeRuns(runFiles, fileOutput(outputFile), M, a);
+}
+
+void MergeSort::mergeRuns(const std::vector<std::string>& runFiles,
+                          const MergeOutput& output, size_t M, size_t a) {
   size_t K = runFiles.size();
 
   if (K == 0) return;
-  if (K == 1) {
-    std::filesystem::copy_file(
-        runFiles[0], outputFile,
-        std::filesystem::copy_options::overwrite_existing);
+  if (K <= a) {
+    mergeBatch(runFiles, output, M);
     return;
   }
 
-  size_t bufferSize = calculateOptimalBufferSize(M, K, a);
+  std::vector<size_t> runSizes(K);
+  for (size_t i = 0; i < K; i++) {
+    runSizes[i] = std::filesystem::file_size(runFiles[i]) / sizeof(int64_t);
+  }
 
-  size_t mergeAtOnce = std::min(K, a);
+  std::vector<MergeStep> plan = planMerges(runSizes, a);
 
-  std::cout << "Merging " << K << " runs using " << mergeAtOnce
-            << "-way merge with buffer size " << bufferSize << std::endl;
+  std::vector<size_t> levelVolume;
+  for (const auto& step : plan) {
+    if (levelVolume.size() < step.level) levelVolume.resize(step.level, 0);
+    levelVolume[step.level - 1] += step.elements;
+  }
+
+  size_t totalElements = 0;
+  for (size_t size : runSizes) totalElements += size;
+  size_t mergedVolume = 0;
+  for (size_t volume : levelVolume) mergedVolume += volume;
 
-  if (K > mergeAtOnce) {
-    std::vector<std::string> intermediateRunFiles;
+  std::cout << "Merging " << K << " runs with " << plan.size() << " merges of "
+            << "up to " << a << " runs" << std::endl;
+  for (size_t level = 0; level < levelVolume.size(); level++) {
+    std::cout << "  Pass " << level + 1 << ": " << levelVolume[level]
+              << " elements merged" << std::endl;
+  }
+  std::cout << "  Total merged volume: " << mergedVolume << " elements ("
+            << (totalElements > 0 ? double(mergedVolume) / totalElements : 0)
+            << " passes over the data)" << std::endl;
 
-    for (size_t i = 0; i < K; i += mergeAtOnce) {
-      size_t endIdx = std::min(i + mergeAtOnce, K);
-      std::vector<std::string> batchRuns(runFiles.begin() + i,
-                                         runFiles.begin() + endIdx);
+  std::vector<std::string> files = runFiles;
+  for (size_t i = 0; i < plan.size(); i++) {
+    const MergeStep& step = plan[i];
 
-      std::string intermediateFile = runFiles[0] + ".intermediate_" +
-                                     std::to_string(i / mergeAtOnce) + ".bin";
-      mergeRuns(batchRuns, intermediateFile, M, mergeAtOnce);
-      intermediateRunFiles.push_back(intermediateFile);
+    std::vector<std::string> inputs;
+    for (size_t input : step.inputs) {
+      inputs.push_back(files[input]);
     }
 
-    mergeRuns(intermediateRunFiles, outputFile, M, a);
+    if (i + 1 == plan.size()) {
+      mergeBatch(inputs, output, M);
+    } else {
+      std::string stepOutput =
+          runFiles[0] + ".intermediate_" + std::to_string(i) + ".bin";
+      mergeBatch(inputs, fileOutput(stepOutput), M);
+      files.push_back(stepOutput);
+    }
 
-    for (const auto& file : intermediateRunFiles) {
-      std::filesystem::remove(file);
+    for (size_t input : step.inputs) {
+      if (input >= K) {
+        std::filesystem::remove(files[input]);
+      }
     }
+  }
+}
+
+void MergeSort::mergeBatch(const std::vector<std::string>& runFiles,
+                           const MergeOutput& output, size_t M) {
+  size_t K = runFiles.size();
 
+  std::vector<RunRange> ranges(K);
+  size_t totalElements = 0;
+  for (size_t i = 0; i < K; i++) {
+    ranges[i] = {0, std::filesystem::file_size(runFiles[i]) / sizeof(int64_t)};
+    totalElements += ranges[i].end;
+  }
+
+  if (output.positional && threadCount > 1 &&
+      totalElements >= threadCount * 4096) {
+    mergeRunsParallel(runFiles, ranges, output, M);
     return;
   }
 
-  std::vector<std::ifstream> runStreams(K);
-  for (size_t i = 0; i < K; i++) {
-    runStreams[i].open(runFiles[i], std::ios::binary);
-    if (!runStreams[i].is_open()) {
-      throw std::runtime_error("Could not open run file: " + runFiles[i]);
+  // Every run and the output keep a second buffer filled in the background.
+  size_t bufferSize = calculateOptimalBufferSize(M, totalElements, K, 2);
+
+  std::cout << "Merging " << K << " runs using " << K
+            << "-way merge with buffer size " << bufferSize << std::endl;
+
+  mergeRange(runFiles, ranges, output.at(0), bufferSize);
+}
+
+MergeSort::MergeSink MergeSort::fileSink(std::ostream& out, IoContext& io) {
+  size_t written = 0;
+  return [&out, &io, written](const int64_t* data, size_t count) mutable {
+    size_t bytes = count * sizeof(int64_t);
+    out.write(reinterpret_cast<const char*>(data), bytes);
+    if (!out) {
+      throw std::runtime_error("Error writing merged output");
     }
-  }
+    io.recordWrite(written, bytes);
+    written += bytes;
+  };
+}
+
+MergeSort::MergeSink MergeSort::bufferSink(int64_t* dest) {
+  return [dest](const int64_t* data, size_t count) mutable {
+    dest = std::copy(data, data + count, dest);
+  };
+}
+
+MergeSort::MergeSink MergeSort::descriptorSink(int fd, IoContext& io) {
+  size_t written = 0;
+  return [fd, &io, written](const int64_t* data, size_t count) mutable {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    size_t left = count * sizeof(int64_t);
+    io.recordWrite(written, left);
+    written += left;
+    while (left > 0) {
+      ssize_t put = ::write(fd, bytes, left);
+      if (put < 0) {
+        if (errno == EINTR) continue;
+        throw std::runtime_error("Error writing to file descriptor " +
+                                 std::to_string(fd));
+      }
+      bytes += put;
+      left -= static_cast<size_t>(put);
+    }
+  };
+}
 
-  std::ofstream outStream(outputFile, std::ios::binary);
-  if (!outStream.is_open()) {
-    throw std::runtime_error("Could not create output file: " + outputFile);
+MergeSort::MergeOutput MergeSort::fileOutput(const std::string& path) {
+  // Positional writes need no seek, so concurrent parts share one file.
+  auto file = std::make_shared<IoContext::File>(io.open(path, OpenMode::Write));
+
+  return {[file](size_t offset) {
+            size_t position = offset * sizeof(int64_t);
+            return MergeSink([file, position](const int64_t* data,
+                                              size_t count) mutable {
+              file->write(position, data, count * sizeof(int64_t));
+              position += count * sizeof(int64_t);
+            });
+          },
+          true};
+}
+
+MergeSort::MergeOutput MergeSort::bufferOutput(int64_t* dest) {
+  return {[dest](size_t offset) { return bufferSink(dest + offset); }, true};
+}
+
+MergeSort::MergeOutput MergeSort::sinkOutput(const MergeSink& sink) {
+  return {[sink](size_t) { return sink; }, false};
+}
+
+void MergeSort::mergeRange(const std::vector<std::string>& runFiles,
+                           const std::vector<RunRange>& ranges,
+                           const MergeSink& sink, size_t bufferSize) {
+  size_t K = runFiles.size();
+  bufferSize = io.alignedCount(bufferSize, sizeof(int64_t));
+
+  std::vector<IoContext::File> runs;
+  std::vector<size_t> positions(K);
+  std::vector<size_t> remaining(K);
+  for (size_t i = 0; i < K; i++) {
+    runs.push_back(io.open(runFiles[i], OpenMode::Read));
+    positions[i] = ranges[i].begin;
+    remaining[i] = ranges[i].end - ranges[i].begin;
   }
 
-  std::vector<std::vector<int64_t>> buffers(K);
+  // Buffers never grow past bufferSize, so their addresses stay fixed and
+  // can be registered with the queue.
+  std::vector<AlignedVector<int64_t>> buffers(K);
+  std::vector<AlignedVector<int64_t>> prefetchBuffers(K);
   std::vector<size_t> bufferPos(K, 0);
-  std::vector<bool> runExhausted(K, false);
+  std::vector<std::pair<void*, size_t>> regions;
+  std::vector<BlockFile*> files;
+  for (size_t i = 0; i < K; i++) {
+    buffers[i].reserve(std::min(bufferSize, remaining[i]));
+    prefetchBuffers[i].reserve(std::min(bufferSize, remaining[i]));
+    regions.push_back(
+        {buffers[i].data(), buffers[i].capacity() * sizeof(int64_t)});
+    regions.push_back({prefetchBuffers[i].data(),
+                       prefetchBuffers[i].capacity() * sizeof(int64_t)});
+    files.push_back(&runs[i].blockFile());
+  }
+  LoserTree<int64_t> tree(K);
+
+  AlignedVector<int64_t> outputBuffer(bufferSize);
+  AlignedVector<int64_t> writeBuffer(bufferSize);
+  std::future<void> pendingWrite;
+  size_t outputCount = 0;
+
+  // Declared after the buffers so that both are drained before the buffers
+  // their requests use are destroyed. Run refills go through the queue, up
+  // to its depth at once; a single worker writes the output in order.
+  std::unique_ptr<IoQueue> queue = io.createQueue();
+  queue->registerBuffers(regions);
+  queue->registerFiles(files);
+  std::vector<size_t> tickets(K);
+  ThreadPool ioPool(1);
+
+  auto prefetch = [&](size_t runIdx) {
+    AlignedVector<int64_t>& buffer = prefetchBuffers[runIdx];
+    buffer.resize(std::min(bufferSize, remaining[runIdx]));
+    if (buffer.empty()) return;
+
+    tickets[runIdx] = queue->read(runs[runIdx].blockFile(),
+                                  positions[runIdx] * sizeof(int64_t),
+                                  buffer.data(),
+                                  buffer.size() * sizeof(int64_t));
+    positions[runIdx] += buffer.size();
+    remaining[runIdx] -= buffer.size();
+  };
+
+  auto refill = [&](size_t runIdx) {
+    AlignedVector<int64_t>& buffer = prefetchBuffers[runIdx];
+    if (!buffer.empty() &&
+        queue->wait(tickets[runIdx]) != buffer.size() * sizeof(int64_t)) {
+      throw std::runtime_error("Unexpected end of run file: " +
+                               runFiles[runIdx]);
+    }
+    buffers[runIdx].swap(buffer);
+    bufferPos[runIdx] = 0;
 
+    if (buffers[runIdx].empty()) {
+      return false;
+    }
+    prefetch(runIdx);
+    queue->submit();
+    return true;
+  };
+
+  auto flushOutput = [&]() {
+    if (pendingWrite.valid()) {
+      pendingWrite.get();
+    }
+    outputBuffer.swap(writeBuffer);
+
+    size_t count = outputCount;
+    outputCount = 0;
+    pendingWrite =
+        ioPool.submit([&, count] { sink(writeBuffer.data(), count); });
+  };
+
+  // The first block of every run is requested in one batch.
+  for (size_t i = 0; i < K; i++) {
+    prefetch(i);
+  }
+  queue->submit();
   for (size_t i = 0; i < K; i++) {
-    buffers[i].resize(bufferSize);
+    if (refill(i)) {
+      tree.setLeaf(i, buffers[i][0]);
+    }
+  }
+  tree.build();
 
-    runStreams[i].read(reinterpret_cast<char*>(buffers[i].data()),
-                       bufferSize * sizeof(int64_t));
-    size_t elementsRead = runStreams[i].gcount() / sizeof(int64_t);
-    buffers[i].resize(elementsRead);
+  while (!tree.empty()) {
+    size_t runIdx = tree.winner();
+    outputBuffer[outputCount++] = tree.winnerKey();
 
-    if (elementsRead == 0) {
-      runExhausted[i] = true;
+    if (outputCount == bufferSize) {
+      flushOutput();
     }
 
-    disk_read_count++;
+    size_t posInRun = ++bufferPos[runIdx];
+    if (posInRun < buffers[runIdx].size()) {
+      tree.replaceWinner(buffers[runIdx][posInRun]);
+    } else if (refill(runIdx)) {
+      tree.replaceWinner(buffers[runIdx][0]);
+    } else {
+      tree.removeWinner();
+    }
   }
 
-  std::priority_queue<HeapNode, std::vector<HeapNode>, std::greater<HeapNode>>
-      minHeap;
+  if (outputCount > 0) {
+    flushOutput();
+  }
+  if (pendingWrite.valid()) {
+    pendingWrite.get();
+  }
+}
+
+std::vector<std::vector<MergeSort::RunRange>> MergeSort::splitRanges(
+    const std::vector<std::string>& runFiles,
+    const std::vector<RunRange>& ranges, size_t parts) {
+  size_t K = runFiles.size();
+
+  std::vector<IoContext::File> runs;
+  for (size_t i = 0; i < K; i++) {
+    runs.push_back(io.open(runFiles[i], OpenMode::Read));
+  }
 
+  auto readAt = [&runs](size_t runIdx, size_t pos) {
+    int64_t value = 0;
+    runs[runIdx].read(pos * sizeof(int64_t), &value, sizeof(int64_t));
+    return value;
+  };
+
+  // Splitters are quantiles of an evenly strided sample of every run,
+  // weighted by run length through the stride.
+  size_t totalElements = 0;
+  for (const auto& range : ranges) {
+    totalElements += range.end - range.begin;
+  }
+  size_t samplesPerPart = 64;
+  size_t stride =
+      std::max(size_t(1), totalElements / (parts * samplesPerPart));
+
+  std::vector<int64_t> samples;
   for (size_t i = 0; i < K; i++) {
-    if (!runExhausted[i]) {
-      minHeap.push({buffers[i][0], i, 0});
+    for (size_t pos = ranges[i].begin + stride / 2; pos < ranges[i].end;
+         pos += stride) {
+      samples.push_back(readAt(i, pos));
     }
   }
+  std::sort(samples.begin(), samples.end());
 
-  std::vector<int64_t> outputBuffer;
-  outputBuffer.reserve(bufferSize);
+  std::vector<std::vector<RunRange>> result(parts, ranges);
+  if (samples.empty()) {
+    result.resize(1);
+    return result;
+  }
 
-  while (!minHeap.empty()) {
-    HeapNode top = minHeap.top();
-    minHeap.pop();
+  std::vector<size_t> previous(K);
+  for (size_t i = 0; i < K; i++) {
+    previous[i] = ranges[i].begin;
+  }
 
-    outputBuffer.push_back(top.value);
+  for (size_t part = 0; part + 1 < parts; part++) {
+    int64_t splitter = samples[(part + 1) * samples.size() / parts];
+
+    for (size_t i = 0; i < K; i++) {
+      size_t lo = previous[i];
+      size_t hi = ranges[i].end;
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (readAt(i, mid) < splitter) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
 
-    if (outputBuffer.size() >= bufferSize) {
-      outStream.write(reinterpret_cast<const char*>(outputBuffer.data()),
-                      outputBuffer.size() * sizeof(int64_t));
-      disk_write_count++;
-      outputBuffer.clear();
+      result[part][i] = {previous[i], lo};
+      previous[i] = lo;
     }
+  }
+  for (size_t i = 0; i < K; i++) {
+    result[parts - 1][i] = {previous[i], ranges[i].end};
+  }
 
-    size_t runIdx = top.runIndex;
-    size_t posInRun = top.posInRun + 1;
+  return result;
+}
 
-    if (posInRun >= buffers[runIdx].size()) {
-      buffers[runIdx].resize(bufferSize);
-      bufferPos[runIdx] = 0;
+void MergeSort::mergeRunsParallel(const std::vector<std::string>& runFiles,
+                                  const std::vector<RunRange>& ranges,
+                                  const MergeOutput& output, size_t M) {
+  size_t K = runFiles.size();
+  size_t totalElements = 0;
+  for (const auto& range : ranges) {
+    totalElements += range.end - range.begin;
+  }
 
-      runStreams[runIdx].read(reinterpret_cast<char*>(buffers[runIdx].data()),
-                              bufferSize * sizeof(int64_t));
-      size_t elementsRead = runStreams[runIdx].gcount() / sizeof(int64_t);
+  std::vector<std::vector<RunRange>> parts =
+      splitRanges(runFiles, ranges, threadCount);
 
-      if (elementsRead == 0) {
-        runExhausted[runIdx] = true;
-      } else {
-        buffers[runIdx].resize(elementsRead);
+  // Each part merges with its own share of the memory budget.
+  size_t bufferSize = calculateOptimalBufferSize(
+      M / parts.size(), totalElements / parts.size(), K, 2);
 
-        minHeap.push({buffers[runIdx][0], runIdx, 0});
+  std::cout << "Merging " << K << " runs using " << K << "-way merge on "
+            << parts.size() << " threads with buffer size " << bufferSize
+            << std::endl;
 
-        disk_read_count++;
-      }
-    } else {
-      minHeap.push({buffers[runIdx][posInRun], runIdx, posInRun});
+  ThreadPool pool(parts.size());
+  std::vector<std::future<void>> merged;
+  size_t outputOffset = 0;
+
+  for (const auto& part : parts) {
+    size_t offset = outputOffset;
+    for (const auto& range : part) {
+      outputOffset += range.end - range.begin;
     }
-  }
 
-  if (!outputBuffer.empty()) {
-    outStream.write(reinterpret_cast<const char*>(outputBuffer.data()),
-                    outputBuffer.size() * sizeof(int64_t));
-    disk_write_count++;
+    merged.push_back(pool.submit([&, offset] {
+      mergeRange(runFiles, part, output.at(offset), bufferSize);
+    }));
   }
 
-  for (auto& stream : runStreams) {
-    stream.close();
+  for (auto& future : merged) {
+    future.get();
   }
-  outStream.close();
 }
 
 void MergeSort::mergeSortedRuns(const std::vector<std::string>& runFiles,
-                                std::vector<int64_t>& output, size_t M,
-                                size_t a) {
-  std::string outputFile = "data/mergesort_temp/final_output.bin";
-
-  mergeRuns(runFiles, outputFile, M, a);
-
-  output = readInt64DataFromFile(outputFile);
-
-  std::filesystem::remove(outputFile);
+                                int64_t* output, size_t M, size_t a) {
+  mergeRuns(runFiles, bufferOutput(output), M, a);
 }
 
 void MergeSort::externalSort(std::vector<int64_t>& arr, size_t M, size_t a) {
-  if (arr.empty()) return;
+  sortView(arr.data(), arr.size(), arr.data(), M, a);
+}
+
+void MergeSort::sortView(const int64_t* input, size_t n, int64_t* output,
+                         size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  if (n == 0) return;
 
   std::cout << "Running external mergesort with M=" << M << ", a=" << a
-            << " for " << arr.size() << " elements" << std::endl;
+            << " for " << n << " elements" << std::endl;
 
   resetDiskCounters();
+  io.reset();
 
+  bool merging = false;
   try {
-    std::string tempDir = "data/mergesort_temp";
+    const std::string& tempDir = tempDirectory;
     std::filesystem::create_directories(tempDir);
 
-    size_t runSize = M / 2;
-    if (runSize == 0) runSize = 1;
-
     std::vector<std::string> runFiles =
-        createInitialRuns(arr, runSize, tempDir);
+        createInitialRuns(input, n, mergeRunElements(M), tempDir);
     std::cout << "Created " << runFiles.size() << " initial runs" << std::endl;
 
-    mergeSortedRuns(runFiles, arr, M, a);
+    merging = true;
+    mergeSortedRuns(runFiles, output, M, a);
 
     for (const auto& file : runFiles) {
       std::filesystem::remove(file);
@@ -276,21 +762,179 @@ void MergeSort::externalSort(std::vector<int64_t>& arr, size_t M, size_t a) {
   } catch (const std::exception& e) {
     std::cerr << "Error in external mergesort: " << e.what() << std::endl;
 
+    // An in-place merge has already overwritten part of the input, so the
+    // keys can no longer be recovered from it.
+    if (merging && input == output) {
+      throw;
+    }
+
     std::cerr << "Falling back to in-memory sort" << std::endl;
-    std::sort(arr.begin(), arr.end());
+    if (input != output) {
+      std::copy(input, input + n, output);
+    }
+    std::sort(output, output + n);
+  }
+}
+
+std::vector<std::string> MergeSort::createSortFileRuns(
+    const std::string& inputPath, size_t M, size_t a) {
+  std::cout << "Running file external mergesort with M=" << M << ", a=" << a
+            << " on " << inputPath << std::endl;
+
+  resetDiskCounters();
+  io.reset();
+
+  const std::string& tempDir = tempDirectory;
+  std::filesystem::create_directories(tempDir);
+
+  std::vector<std::string> runFiles =
+      createInitialRunsFromFile(inputPath, mergeRunElements(M), tempDir);
+  std::cout << "Created " << runFiles.size() << " initial runs" << std::endl;
+
+  return runFiles;
+}
+
+void MergeSort::sortFile(const std::string& inputPath,
+                         const std::string& outputPath, size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  std::vector<std::string> runFiles = createSortFileRuns(inputPath, M, a);
+
+  // The output is only created once the input has been consumed, so it may
+  // replace the input file.
+  mergeRuns(runFiles, fileOutput(outputPath), M, a);
+
+  for (const auto& file : runFiles) {
+    std::filesystem::remove(file);
+  }
+}
+
+void MergeSort::sortFileTo(const std::string& inputPath,
+                           const MergeSink& sink, size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  std::vector<std::string> runFiles = createSortFileRuns(inputPath, M, a);
+
+  mergeRuns(runFiles, sinkOutput(sink), M, a);
+
+  for (const auto& file : runFiles) {
+    std::filesystem::remove(file);
   }
 }
 
 void MergeSort::autoExternalSort(std::vector<int64_t>& arr, size_t M) {
-  size_t elementSize = sizeof(int64_t);
-  size_t blockSize = 4096;
+  SortPlan plan = planSort(SortEngine::MergeSort, arr.size(), M,
+                           CostModel::forMachine());
 
-  size_t bufferElements = blockSize / elementSize;
+  std::cout << "Auto-tuned parameters: M=" << M << ", " << plan << std::endl;
 
-  size_t optimalArity = calculateOptimalArity(M, bufferElements);
+  externalSort(arr, M, plan.arity);
+}
 
-  std::cout << "Auto-tuned parameters: M=" << M
-            << ", calculated optimal arity=" << optimalArity << std::endl;
+SortExplanation MergeSort::explain(size_t N, size_t M, size_t a) const {
+  SortExplanation result{0, 0, 0, 0, 0, 0};
+  if (N == 0) return result;
+
+  auto ceilDiv = [](size_t x, size_t y) { return (x + y - 1) / y; };
+
+  // Run formation, as in sortView, sortFile and generateRuns.
+  size_t runSize = mergeRunElements(M);
+  std::vector<size_t> runSizes;
+  if (runGeneration == RunGeneration::ReplacementSelection) {
+    size_t ioSize =
+        io.alignedCount(std::max(size_t(1), runSize / 16), sizeof(int64_t));
+    size_t heapCapacity =
+        std::max(size_t(1), runSize - std::min(runSize, 2 * ioSize));
+    for (size_t done = 0; done < N; done += runSizes.back()) {
+      runSizes.push_back(std::min(2 * heapCapacity, N - done));
+      result.diskWrites += ceilDiv(runSizes.back(), ioSize);
+    }
+    result.peakBufferBytes = (heapCapacity + 2 * ioSize) * sizeof(int64_t);
+  } else {
+    bool parallel = threadCount > 1 && runSize >= threadCount * 1024;
+    size_t ioSize = io.alignedCount(
+        parallel ? std::max(size_t(1), runSize / 16) : 0, sizeof(int64_t));
+    size_t runCapacity = runSize - ioSize;
+    for (size_t done = 0; done < N; done += runSizes.back()) {
+      runSizes.push_back(std::min(runCapacity, N - done));
+      result.diskWrites += parallel ? ceilDiv(runSizes.back(), ioSize) : 1;
+    }
+    size_t longest = runSizes.front();
+    size_t scratch =
+        parallel || longest >= RADIX_SORT_THRESHOLD ? longest : size_t(0);
+    result.peakBufferBytes =
+        (longest + scratch + ioSize) * sizeof(int64_t);
+  }
 
-  externalSort(arr, M, optimalArity);
-}
\ No newline at end of file
+  size_t K = runSizes.size();
+  result.runs = K;
+
+  // One merge step, as in mergeBatch and mergeRunsParallel.
+  auto merge = [&](const std::vector<size_t>& inputs, size_t elements,
+                   bool last) {
+    size_t fanIn = inputs.size();
+    size_t parts = threadCount > 1 && elements >= threadCount * 4096
+                       ? threadCount
+                       : size_t(1);
+    size_t bufferSize = io.alignedCount(
+        calculateOptimalBufferSize(M / parts, elements / parts, fanIn, 2),
+        sizeof(int64_t));
+
+    for (size_t size : inputs) {
+      size_t share = ceilDiv(size, parts);
+      result.diskReads += parts * ceilDiv(share, bufferSize);
+      if (parts > 1) {
+        // Binary search for every splitter in this run.
+        size_t probes = 0;
+        while ((size_t(1) << probes) <= size) probes++;
+        result.diskReads += (parts - 1) * probes;
+      }
+    }
+    if (parts > 1) {
+      // Strided samples, about 64 per part.
+      size_t stride = std::max(size_t(1), elements / (parts * 64));
+      result.diskReads += elements / stride;
+    }
+    if (!last) {
+      result.diskWrites += parts * ceilDiv(ceilDiv(elements, parts),
+                                           bufferSize);
+    }
+    result.peakBufferBytes =
+        std::max(result.peakBufferBytes,
+                 parts * (2 * fanIn + 2) * bufferSize * sizeof(int64_t));
+  };
+
+  // The initial runs stay on disk until the final merge is done;
+  // intermediate results are removed as soon as they are consumed.
+  size_t liveBytes = N * sizeof(int64_t);
+  result.peakTempBytes = liveBytes;
+
+  if (K <= a) {
+    merge(runSizes, N, true);
+    result.passes = 1;
+    return result;
+  }
+
+  std::vector<MergeStep> plan = planMerges(runSizes, a);
+  std::vector<size_t> sizes = runSizes;
+  for (size_t i = 0; i < plan.size(); i++) {
+    const MergeStep& step = plan[i];
+    bool last = i + 1 == plan.size();
+
+    std::vector<size_t> inputs;
+    for (size_t input : step.inputs) {
+      inputs.push_back(sizes[input]);
+    }
+    merge(inputs, step.elements, last);
+    sizes.push_back(step.elements);
+
+    if (!last) {
+      liveBytes += step.elements * sizeof(int64_t);
+      result.peakTempBytes = std::max(result.peakTempBytes, liveBytes);
+    }
+    for (size_t input : step.inputs) {
+      if (input >= K) liveBytes -= sizes[input] * sizeof(int64_t);
+    }
+    result.passes = std::max(result.passes, step.level);
+  }
+
+  return result;
+}
@@ -1,281 +1,582 @@
 #include "algorithms/quicksort.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <random>
 #include <string>
 #include <vector>
 
+#include "algorithms/lsd_radix_sort.h"
+#include "algorithms/splitter_tree.h"
+#include "utils/aligned_buffer_pool.h"
 #include "utils/file_handler.h"
+#include "utils/memory_budget.h"
+#include "utils/quantile_sketch.h"
 #include "utils/sort_parameters.h"
-
-void QuickSort::externalQuickSort(std::vector<int64_t>& arr, size_t M,
-                                  size_t a) {
-  if (arr.size() <= 1) {
-    return;
+#include "utils/sort_planner.h"
+#include "utils/thread_pool.h"
+
+void QuickSort::sortInMemory(int64_t* data, size_t n, size_t M) {
+  // The radix kernel needs a scratch copy, so it is only used when both fit
+  // in M together. The scratch comes from the pool, which counts it against
+  // the sort's budget.
+  if (2 * n * sizeof(int64_t) <= M) {
+    AlignedVector<int64_t> scratch;
+    sortKeys(data, n, scratch);
+  } else {
+    std::sort(data, data + n);
   }
+}
 
-  if (arr.size() * sizeof(int64_t) <= M) {
-    std::string tempFile = "data/quicksort_temp/in_memory_sort.bin";
-    std::filesystem::create_directories("data/quicksort_temp");
-    writeInt64DataToFile(arr, tempFile);
-    std::sort(arr.begin(), arr.end());
-    writeInt64DataToFile(arr, tempFile + ".sorted");
-    std::filesystem::remove(tempFile);
-    std::filesystem::remove(tempFile + ".sorted");
-    return;
-  }
+QuickSort::PartitionInput QuickSort::fileInput(const std::string& path) {
+  auto file = std::make_shared<IoContext::File>(io.open(path, OpenMode::Read));
+
+  size_t size = file->size() / sizeof(int64_t);
+  return {size,
+          [file](size_t offset, int64_t* dest, size_t count) {
+            return file->read(offset * sizeof(int64_t), dest,
+                              count * sizeof(int64_t)) /
+                   sizeof(int64_t);
+          },
+          nullptr};
+}
 
-  try {
-    std::string tempDir = "data/quicksort_temp";
-    std::filesystem::create_directories(tempDir);
+QuickSort::PartitionInput QuickSort::arrayInput(const int64_t* data,
+                                               size_t size) {
+  return {size,
+          [data, size](size_t offset, int64_t* dest, size_t count) {
+            count = std::min(count, size - std::min(offset, size));
+            std::copy(data + offset, data + offset + count, dest);
+            return count;
+          },
+          nullptr, data};
+}
 
-    size_t effective_a = a;
-    if (a > arr.size() / 100) {
-      effective_a = std::max(size_t(2), std::min(a, arr.size() / 100));
+void QuickSort::externalQuickSort(const int64_t* input, size_t n,
+                                  int64_t* output, size_t M, size_t a) {
+  if (n <= 1 || n * sizeof(int64_t) <= M) {
+    if (input != output) {
+      std::copy(input, input + n, output);
     }
+    sortInMemory(output, n, M);
+    return;
+  }
 
-    std::string inputFile = tempDir + "/input.bin";
-    writeInt64DataToFile(arr, inputFile);
+  // Every element is copied out to a partition file before the first
+  // sorted partition is written back, so input can be source and
+  // destination.
+  std::atomic<bool> written{false};
+  PartitionOutput write = [output, &written](size_t offset,
+                                             const int64_t* block,
+                                             size_t count) {
+    written = true;
+    std::copy(block, block + count, output + offset);
+  };
 
-    size_t sampleSize = std::min(arr.size(), size_t(1000));
-    size_t step = arr.size() / sampleSize;
-    std::vector<int64_t> samples;
-    for (size_t i = 0; i < arr.size(); i += step) {
-      samples.push_back(arr[i]);
-    }
-    std::sort(samples.begin(), samples.end());
+  try {
+    runDistributionSort(arrayInput(input, n), write, M, a);
+  } catch (const std::exception& e) {
+    std::cerr << "Error in external quicksort: " << e.what() << std::endl;
 
-    std::vector<int64_t> pivots;
-    if (effective_a > 1) {
-      size_t pivotStep = samples.size() / effective_a;
-      for (size_t i = 1; i < effective_a; i++) {
-        pivots.push_back(samples[i * pivotStep]);
-      }
+    // Sorted partitions written in place have replaced input keys that
+    // only their partition files held, so the array cannot be re-sorted.
+    if (written && input == output) {
+      throw;
     }
 
-    std::vector<std::vector<int64_t>> partitionBuffers(effective_a);
-    std::vector<std::string> partitionFiles(effective_a);
+    std::cerr << "Falling back to in-memory sort" << std::endl;
+    if (input != output) {
+      std::copy(input, input + n, output);
+    }
+    std::sort(output, output + n);
+  }
+}
 
-    size_t elementSize = sizeof(int64_t);
-    size_t totalBuffers = effective_a + 1;
-    size_t bufferSize = (M * 0.8) / (totalBuffers * elementSize);
-    bufferSize = std::max(size_t(1000), bufferSize);
+std::shared_ptr<const QuantileSketch> QuickSort::sampleInput(
+    const PartitionInput& input, size_t sampleSize) {
+  sampleSize = std::min(input.size, sampleSize);
 
-    for (size_t i = 0; i < effective_a; i++) {
-      partitionFiles[i] = tempDir + "/partition_" + std::to_string(i) + ".bin";
-      partitionBuffers[i].reserve(bufferSize);
+  std::mt19937_64 rng(input.size);
+  std::uniform_int_distribution<size_t> position(0, input.size - 1);
+  std::vector<size_t> positions(sampleSize);
+  for (auto& pos : positions) {
+    pos = position(rng);
+  }
+  std::sort(positions.begin(), positions.end());
+
+  // Samples are taken in position order, reading each block they fall in
+  // once.
+  auto sketch = std::make_shared<QuantileSketch>(sampleSize);
+  std::vector<int64_t> block(INTS_PER_BLOCK);
+  size_t blockStart = std::numeric_limits<size_t>::max();
+  for (size_t pos : positions) {
+    size_t start = pos - pos % INTS_PER_BLOCK;
+    if (start != blockStart) {
+      input.read(start, block.data(),
+                 std::min(INTS_PER_BLOCK, input.size - start));
+      blockStart = start;
     }
+    sketch->update(block[pos - start]);
+  }
+  return sketch;
+}
+
+void QuickSort::runDistributionSort(const PartitionInput& input,
+                                    const PartitionOutput& output, size_t M,
+                                    size_t a) {
+  std::unique_ptr<ThreadPool> pool;
+  if (threadCount > 1) {
+    pool = std::make_unique<ThreadPool>(threadCount);
+  }
 
-    std::vector<int64_t> readBuffer;
-    readBuffer.reserve(bufferSize);
+  MemoryBudget budget(M);
+  TaskGroup tasks(pool.get());
+  distributionSort(input, output, 0, M, a, 0, tasks, budget);
+  tasks.wait();
+}
 
-    std::cout << "Using " << effective_a << "-way partitioning for QuickSort"
-              << std::endl;
+void QuickSort::distributionSort(const PartitionInput& input,
+                                 const PartitionOutput& output,
+                                 size_t outputOffset, size_t M, size_t a,
+                                 size_t depth, TaskGroup& tasks,
+                                 MemoryBudget& budget) {
+  size_t n = input.size;
+  if (n == 0) {
+    return;
+  }
 
-    std::ifstream inFile(inputFile, std::ios::binary);
-    if (!inFile) {
-      throw std::runtime_error("Could not open input file: " + inputFile);
+  if (n * sizeof(int64_t) <= M) {
+    // sortInMemory adds a radix scratch buffer of the same size when both
+    // fit in M.
+    size_t bytes = n * sizeof(int64_t);
+    MemoryBudget::Reservation reservation(budget,
+                                          2 * bytes <= M ? 2 * bytes : bytes);
+    AlignedVector<int64_t> data(n);
+    if (input.read(0, data.data(), n) != n) {
+      throw std::runtime_error("Unexpected end of partition input");
     }
+    sortInMemory(data.data(), n, M);
+    output(outputOffset, data.data(), data.size());
+    return;
+  }
 
-    while (inFile) {
-      readBuffer.resize(bufferSize);
-      inFile.read(reinterpret_cast<char*>(readBuffer.data()),
-                  bufferSize * sizeof(int64_t));
-      size_t elementsRead = inFile.gcount() / sizeof(int64_t);
-      readBuffer.resize(elementsRead);
+  std::string tempDir = "data/quicksort_temp";
 
-      if (elementsRead == 0) {
-        break;
-      }
+  size_t effective_a = a;
+  if (a > n / 100) {
+    effective_a = std::max(size_t(2), std::min(a, n / 100));
+  }
 
-      for (const auto& element : readBuffer) {
-        size_t partitionIdx = 0;
-        while (partitionIdx < pivots.size() &&
-               element >= pivots[partitionIdx]) {
-          partitionIdx++;
-        }
+  // Pivots come from a quantile sketch. A partition written by a parent
+  // pass carries a sketch of all its keys; otherwise one is built from
+  // samples at random positions, which periodic data cannot align with.
+  std::shared_ptr<const QuantileSketch> sketch = input.sketch;
+  if (!sketch) {
+    sketch = sampleInput(input, std::max(size_t(1000), effective_a * 32));
+  }
 
-        partitionBuffers[partitionIdx].push_back(element);
+  // A key that holds at least one bucket's share of the input gets an
+  // equality bucket [v, v + 1) of its own. It comes out constant and is
+  // emitted without recursing, instead of swamping a range bucket.
+  std::vector<int64_t> pivots;
+  size_t share = std::max(size_t(1), sketch->count() / effective_a);
+  for (int64_t candidate : sketch->splitters(effective_a)) {
+    pivots.push_back(candidate);
+    if (candidate != std::numeric_limits<int64_t>::max() &&
+        sketch->rank(candidate + 1) - sketch->rank(candidate) >= share) {
+      pivots.push_back(candidate + 1);
+    }
+  }
+  std::sort(pivots.begin(), pivots.end());
+  pivots.erase(std::unique(pivots.begin(), pivots.end()), pivots.end());
+
+  // A single distinct pivot may leave every element on one side; splitting
+  // off its equal keys guarantees that each level makes progress.
+  if (pivots.size() <= 1) {
+    int64_t pivot = pivots.empty() ? sketch->quantile(0.5) : pivots[0];
+    pivots = {pivot};
+    if (pivot != std::numeric_limits<int64_t>::max()) {
+      pivots.push_back(pivot + 1);
+    }
+  }
 
-        if (partitionBuffers[partitionIdx].size() >= bufferSize) {
-          appendInt64DataToFile(partitionBuffers[partitionIdx],
-                                partitionFiles[partitionIdx]);
-          partitionBuffers[partitionIdx].clear();
-        }
+  size_t partitionCount = pivots.size() + 1;
+
+  // The parallel pass also keeps one partition index per element of the
+  // read block. The write-behind spares are written while the partition
+  // buffers keep filling.
+  ThreadPool* pool = tasks.getPool();
+  size_t threads = pool != nullptr ? threadCount : 1;
+  size_t totalBuffers = distributionBuffers(partitionCount, threads);
+  size_t bufferSize = io.alignedCount(
+      distributionBufferElements(M, partitionCount, threads),
+      sizeof(int64_t));
+  MemoryBudget::Reservation reservation(
+      budget, totalBuffers * bufferSize * sizeof(int64_t));
+
+  PartitionWriters writers;
+  writers.files.resize(partitionCount);
+  writers.sizes.assign(partitionCount, 0);
+  writers.minKeys.assign(partitionCount, std::numeric_limits<int64_t>::max());
+  writers.maxKeys.assign(partitionCount, std::numeric_limits<int64_t>::min());
+  // Each partition keeps a sketch for its own pivots, fed with about
+  // 16 * k keys so that sampling costs a counter decrement per key.
+  size_t sampleGap = std::max(
+      size_t(1), n / partitionCount / (16 * QuantileSketch::DEFAULT_K));
+  writers.sketches.assign(partitionCount,
+                          QuantileSketch(QuantileSketch::DEFAULT_K, sampleGap));
+
+  for (size_t i = 0; i < partitionCount; i++) {
+    // Concurrent passes at one depth cover disjoint output ranges, so the
+    // output offset makes their file names unique.
+    writers.files[i] = tempDir + "/level_" + std::to_string(depth) +
+                       "_offset_" + std::to_string(outputOffset) +
+                       "_partition_" + std::to_string(i) + ".bin";
+  }
+  writers.set =
+      std::make_unique<PartitionWriterSet>(io, writers.files, bufferSize);
+
+  auto classifier = std::make_unique<SplitterTree<int64_t>>(pivots);
+  std::vector<uint32_t> buckets(pool != nullptr ? bufferSize : CLASSIFY_CHUNK);
+
+  // Elements already in memory are classified in place.
+  AlignedVector<int64_t> readBuffer(input.data != nullptr ? 0 : bufferSize);
+
+  for (size_t position = 0; position < n;) {
+    const int64_t* block = readBuffer.data();
+    size_t elementsRead = std::min(bufferSize, n - position);
+    if (input.data != nullptr) {
+      block = input.data + position;
+    } else {
+      elementsRead = input.read(position, readBuffer.data(), elementsRead);
+      if (elementsRead == 0) {
+        throw std::runtime_error("Unexpected end of partition input");
       }
     }
+    position += elementsRead;
+
+    if (pool != nullptr && elementsRead >= 2 * PARALLEL_SLICE_SIZE) {
+      distributeBlockParallel(block, elementsRead, *classifier,
+                              buckets.data(), writers, *pool);
+    } else {
+      distributeBlock(block, elementsRead, *classifier, buckets.data(),
+                      writers);
+    }
+  }
 
-    for (size_t i = 0; i < effective_a; i++) {
-      if (!partitionBuffers[i].empty()) {
-        appendInt64DataToFile(partitionBuffers[i], partitionFiles[i]);
-        partitionBuffers[i].clear();
-      }
+  writers.set->close();
+  writers.set.reset();
+  AlignedVector<int64_t>().swap(readBuffer);
+  std::vector<uint32_t>().swap(buckets);
+  classifier.reset();
+  reservation.release();
+
+  // Partition i starts where the partitions before it end in the output.
+  // The partitions are independent key ranges, so each one is a task; with
+  // a pool they run concurrently and large ones are partitioned further.
+  size_t partitionOffset = outputOffset;
+  for (size_t i = 0; i < partitionCount; i++) {
+    if (writers.sizes[i] == 0) {
+      std::filesystem::remove(writers.files[i]);
+      continue;
     }
 
-    arr.clear();
-
-    for (size_t i = 0; i < effective_a; i++) {
-      try {
-        std::vector<int64_t> partition =
-            readInt64DataFromFile(partitionFiles[i]);
-
-        externalQuickSort(partition, M, effective_a);
-
-        arr.insert(arr.end(), partition.begin(), partition.end());
-
-        std::filesystem::remove(partitionFiles[i]);
-      } catch (const std::exception& e) {
-        std::cerr << "Error processing partition " << i << ": " << e.what()
-                  << std::endl;
-
-        try {
-          std::vector<int64_t> partition =
-              readInt64DataFromFile(partitionFiles[i]);
-          std::sort(partition.begin(), partition.end());
-          writeInt64DataToFile(partition, partitionFiles[i] + ".sorted");
-          partition = readInt64DataFromFile(partitionFiles[i] + ".sorted");
-          arr.insert(arr.end(), partition.begin(), partition.end());
-          std::filesystem::remove(partitionFiles[i]);
-          std::filesystem::remove(partitionFiles[i] + ".sorted");
-        } catch (const std::exception& e2) {
-          std::cerr << "Couldn't recover partition " << i << ": " << e2.what()
-                    << std::endl;
+    size_t size = writers.sizes[i];
+    int64_t key = writers.minKeys[i];
+    std::string file = writers.files[i];
+    auto childSketch =
+        std::make_shared<const QuantileSketch>(std::move(writers.sketches[i]));
+
+    if (writers.minKeys[i] == writers.maxKeys[i]) {
+      // All keys are equal: the partition is already sorted.
+      std::filesystem::remove(file);
+      tasks.run([&output, &budget, partitionOffset, size, key, bufferSize] {
+        size_t blockSize = std::min(size, bufferSize);
+        MemoryBudget::Reservation blockReservation(
+            budget, blockSize * sizeof(int64_t));
+        std::vector<int64_t> block(blockSize, key);
+        for (size_t done = 0; done < size;) {
+          size_t count = std::min(size - done, block.size());
+          output(partitionOffset + done, block.data(), count);
+          done += count;
         }
-      }
+      });
+    } else {
+      // A partition is split only as finely as it needs to be for its
+      // children to fit in M with 2x slack, so an oversized partition of a
+      // skewed input is re-split in one pass and a barely oversized one
+      // keeps large buffers.
+      size_t needed = (2 * size * sizeof(int64_t) + M - 1) / M;
+      size_t childArity = std::min(effective_a, std::max(size_t(2), needed));
+      tasks.run([this, &output, &tasks, &budget, file, childSketch,
+                 partitionOffset, M, childArity, depth] {
+        PartitionInput child = fileInput(file);
+        child.sketch = childSketch;
+        distributionSort(child, output, partitionOffset, M, childArity,
+                         depth + 1, tasks, budget);
+        std::filesystem::remove(file);
+      });
     }
 
-    std::filesystem::remove(inputFile);
+    partitionOffset += size;
+  }
+}
 
-    try {
-      std::filesystem::remove(tempDir);
-    } catch (const std::exception& e) {
-      std::cerr << "Warning: Could not remove temp directory: " << e.what()
-                << std::endl;
+void QuickSort::distributeBlock(const int64_t* block, size_t n,
+                                const SplitterTree<int64_t>& classifier,
+                                uint32_t* buckets, PartitionWriters& writers) {
+  for (size_t chunk = 0; chunk < n; chunk += CLASSIFY_CHUNK) {
+    size_t chunkSize = std::min(CLASSIFY_CHUNK, n - chunk);
+    const int64_t* elements = block + chunk;
+    classifier.classify(elements, chunkSize, buckets);
+
+    for (size_t j = 0; j < chunkSize; j++) {
+      int64_t element = elements[j];
+      size_t partitionIdx = buckets[j];
+
+      writers.sizes[partitionIdx]++;
+      writers.minKeys[partitionIdx] =
+          std::min(writers.minKeys[partitionIdx], element);
+      writers.maxKeys[partitionIdx] =
+          std::max(writers.maxKeys[partitionIdx], element);
+      writers.sketches[partitionIdx].update(element);
+      writers.set->push(partitionIdx, element);
     }
-  } catch (const std::exception& e) {
-    std::cerr << "Error in external quicksort: " << e.what() << std::endl;
-
-    try {
-      std::cout << "Attempting simplified external QuickSort..." << std::endl;
-
-      std::string tempDir = "data/quicksort_temp";
-      std::filesystem::create_directories(tempDir);
-
-      std::string tempFile = tempDir + "/backup_data.bin";
-      writeInt64DataToFile(arr, tempFile);
-
-      size_t chunkSize = std::min(M / sizeof(int64_t), arr.size());
-      std::vector<std::string> chunkFiles;
-
-      for (size_t offset = 0; offset < arr.size(); offset += chunkSize) {
-        size_t end = std::min(offset + chunkSize, arr.size());
-        std::vector<int64_t> chunk(arr.begin() + offset, arr.begin() + end);
-
-        std::sort(chunk.begin(), chunk.end());
-
-        std::string chunkFile =
-            tempDir + "/chunk_" + std::to_string(chunkFiles.size()) + ".bin";
-        writeInt64DataToFile(chunk, chunkFile);
-        chunkFiles.push_back(chunkFile);
-      }
-
-      arr.clear();
-
-      std::vector<std::ifstream> streams;
-      std::vector<int64_t> topElements;
-      std::vector<bool> streamEnded;
-
-      for (const auto& file : chunkFiles) {
-        streams.emplace_back(file, std::ios::binary);
-        int64_t value;
-        if (streams.back().read(reinterpret_cast<char*>(&value),
-                                sizeof(int64_t))) {
-          topElements.push_back(value);
-          streamEnded.push_back(false);
-        } else {
-          topElements.push_back(std::numeric_limits<int64_t>::max());
-          streamEnded.push_back(true);
-        }
-      }
+  }
+}
 
-      while (true) {
-        size_t minIndex = 0;
-        for (size_t i = 1; i < streams.size(); i++) {
-          if (!streamEnded[i] && (streamEnded[minIndex] ||
-                                  topElements[i] < topElements[minIndex])) {
-            minIndex = i;
-          }
-        }
+void QuickSort::distributeBlockParallel(
+    const int64_t* block, size_t n, const SplitterTree<int64_t>& classifier,
+    uint32_t* buckets, PartitionWriters& writers, ThreadPool& pool) {
+  PartitionWriterSet& set = *writers.set;
+  size_t partitionCount = set.count();
+  size_t slices = std::min(pool.size() + 1, n / PARALLEL_SLICE_SIZE);
+  size_t sliceSize = (n + slices - 1) / slices;
+
+  // Each slice classifies its elements and keeps thread-local counts and
+  // key bounds per partition.
+  std::vector<std::vector<size_t>> counts(
+      slices, std::vector<size_t>(partitionCount, 0));
+  std::vector<std::vector<int64_t>> minKeys(
+      slices, std::vector<int64_t>(partitionCount,
+                                   std::numeric_limits<int64_t>::max()));
+  std::vector<std::vector<int64_t>> maxKeys(
+      slices, std::vector<int64_t>(partitionCount,
+                                   std::numeric_limits<int64_t>::min()));
+
+  parallelFor(&pool, slices, [&](size_t slice) {
+    size_t begin = slice * sliceSize;
+    size_t end = std::min(n, begin + sliceSize);
+    classifier.classify(block + begin, end - begin, buckets + begin);
+    for (size_t i = begin; i < end; i++) {
+      uint32_t p = buckets[i];
+      counts[slice][p]++;
+      minKeys[slice][p] = std::min(minKeys[slice][p], block[i]);
+      maxKeys[slice][p] = std::max(maxKeys[slice][p], block[i]);
+    }
+  });
+
+  std::vector<size_t> totals(partitionCount, 0);
+  for (size_t slice = 0; slice < slices; slice++) {
+    for (size_t p = 0; p < partitionCount; p++) {
+      totals[p] += counts[slice][p];
+      writers.minKeys[p] = std::min(writers.minKeys[p], minKeys[slice][p]);
+      writers.maxKeys[p] = std::max(writers.maxKeys[p], maxKeys[slice][p]);
+    }
+  }
 
-        if (streamEnded[minIndex]) {
-          break;
-        }
+  // Buffers that cannot take their share of the block are flushed first, so
+  // no buffer ever grows past its capacity. The flushes go out as one batch.
+  std::vector<size_t> flushes;
+  for (size_t p = 0; p < partitionCount; p++) {
+    if (set.size(p) + totals[p] > set.capacity()) {
+      flushes.push_back(p);
+    }
+  }
+  set.flush(flushes);
+
+  // Slice s writes partition p right after the elements that slices before
+  // it send to p, so the scatter threads fill disjoint ranges.
+  std::vector<size_t> starts(partitionCount);
+  for (size_t p = 0; p < partitionCount; p++) {
+    size_t offset = set.extend(p, totals[p]);
+    starts[p] = offset;
+    writers.sizes[p] += totals[p];
+    for (size_t slice = 0; slice < slices; slice++) {
+      size_t count = counts[slice][p];
+      counts[slice][p] = offset;
+      offset += count;
+    }
+  }
 
-        arr.push_back(topElements[minIndex]);
+  parallelFor(&pool, slices, [&](size_t slice) {
+    size_t begin = slice * sliceSize;
+    size_t end = std::min(n, begin + sliceSize);
+    std::vector<size_t>& offsets = counts[slice];
+    for (size_t i = begin; i < end; i++) {
+      uint32_t p = buckets[i];
+      set.buffer(p)[offsets[p]++] = block[i];
+    }
+  });
 
-        int64_t value;
-        if (streams[minIndex].read(reinterpret_cast<char*>(&value),
-                                   sizeof(int64_t))) {
-          topElements[minIndex] = value;
-        } else {
-          streamEnded[minIndex] = true;
-          topElements[minIndex] = std::numeric_limits<int64_t>::max();
-        }
-      }
+  parallelFor(&pool, partitionCount, [&](size_t p) {
+    writers.sketches[p].update(set.buffer(p) + starts[p], totals[p]);
+  });
 
-      for (auto& stream : streams) {
-        stream.close();
-      }
-      for (const auto& file : chunkFiles) {
-        std::filesystem::remove(file);
-      }
-      std::filesystem::remove(tempFile);
-
-      std::cout << "Simplified external QuickSort completed successfully"
-                << std::endl;
+  flushes.clear();
+  for (size_t p = 0; p < partitionCount; p++) {
+    if (set.size(p) >= set.capacity()) {
+      flushes.push_back(p);
+    }
+  }
+  set.flush(flushes);
+}
 
-    } catch (const std::exception& e) {
-      std::cerr << "Backup approach also failed: " << e.what() << std::endl;
+void QuickSort::sortFile(const std::string& inputPath,
+                         const std::string& outputPath, size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  std::cout << "Running file external quicksort with M=" << M << ", a=" << a
+            << " on " << inputPath << std::endl;
 
-      std::cerr << "Using disk-based fallback as last resort" << std::endl;
+  std::filesystem::create_directories("data/quicksort_temp");
 
-      std::string tempFile = "data/quicksort_temp/fallback.bin";
-      std::filesystem::create_directories("data/quicksort_temp");
-      writeInt64DataToFile(arr, tempFile);
+  resetDiskCounters();
+  io.reset();
+
+  // The first pass copies the whole input to partition files before any
+  // partition is written back, so the output is created by the first write
+  // and may replace the input file. Partitions write disjoint ranges with
+  // positional writes, so concurrent tasks need no other lock.
+  PartitionInput input = fileInput(inputPath);
+  std::unique_ptr<IoContext::File> output;
+  std::once_flag created;
+  auto create = [this, &output, &outputPath] {
+    output = std::make_unique<IoContext::File>(
+        io.open(outputPath, OpenMode::Write));
+  };
+  PartitionOutput write = [&](size_t offset, const int64_t* data,
+                              size_t count) {
+    std::call_once(created, create);
+    output->write(offset * sizeof(int64_t), data, count * sizeof(int64_t));
+  };
+
+  runDistributionSort(input, write, M, a);
+  std::call_once(created, create);
+}
 
-      std::sort(arr.begin(), arr.end());
+void QuickSort::setThreadCount(size_t threads) {
+  threadCount = std::max(size_t(1), threads);
+}
 
-      writeInt64DataToFile(arr, tempFile + ".sorted");
-      arr = readInt64DataFromFile(tempFile + ".sorted");
+void QuickSort::setBlockDevice(std::shared_ptr<BlockDevice> device) {
+  io.setDevice(std::move(device));
+}
 
-      std::filesystem::remove(tempFile);
-      std::filesystem::remove(tempFile + ".sorted");
-    }
-  }
+void QuickSort::setIoQueue(size_t depth, IoQueueKind kind) {
+  io.setQueue(depth, kind);
 }
 
 void QuickSort::sort(std::vector<int64_t>& arr, size_t M, size_t a) {
+  sortView(arr.data(), arr.size(), arr.data(), M, a);
+}
+
+void QuickSort::sortView(const int64_t* input, size_t n, int64_t* output,
+                         size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
   std::cout << "Running external quicksort with M=" << M << ", a=" << a
-            << " for " << arr.size() << " elements" << std::endl;
+            << " for " << n << " elements" << std::endl;
 
   std::filesystem::create_directories("data/quicksort_temp");
 
   resetDiskCounters();
+  io.reset();
 
-  externalQuickSort(arr, M, a);
+  externalQuickSort(input, n, output, M, a);
 }
 
 void QuickSort::autoSort(std::vector<int64_t>& arr, size_t M) {
-  size_t elementSize = sizeof(int64_t);
-  size_t optimalArity = calculateOptimalArity(M, elementSize);
+  SortPlan plan = planSort(SortEngine::QuickSort, arr.size(), M,
+                           CostModel::forMachine(), threadCount);
 
-  std::cout << "Auto-tuned parameters: M=" << M
-            << ", calculated optimal arity=" << optimalArity << std::endl;
+  std::cout << "Auto-tuned parameters: M=" << M << ", " << plan << std::endl;
 
-  sort(arr, M, optimalArity);
-}
\ No newline at end of file
+  sort(arr, M, plan.arity);
+}
+
+SortExplanation QuickSort::explain(size_t N, size_t M, size_t a) const {
+  SortExplanation result{0, 0, 0, 0, 0, 0};
+  if (N <= 1) return result;
+
+  if (N * sizeof(int64_t) <= M) {
+    size_t bytes = N * sizeof(int64_t);
+    result.peakBufferBytes = 2 * bytes <= M ? 2 * bytes : bytes;
+    return result;
+  }
+
+  // Follows distributionSort on a partition of n keys. peakTempBytes is the
+  // temporary space the partition adds on top of its own input file.
+  std::function<SortExplanation(size_t, size_t, bool)> visit =
+      [&](size_t n, size_t arity, bool onDisk) {
+        SortExplanation part{0, 0, 0, 0, 0, 0};
+        if (n * sizeof(int64_t) <= M) {
+          size_t bytes = n * sizeof(int64_t);
+          part.diskReads = onDisk ? 1 : 0;
+          part.peakBufferBytes = 2 * bytes <= M ? 2 * bytes : bytes;
+          return part;
+        }
+
+        size_t effective_a = arity;
+        if (arity > n / 100) {
+          effective_a = std::max(size_t(2), std::min(arity, n / 100));
+        }
+        size_t partitionCount = effective_a;
+        size_t totalBuffers = distributionBuffers(partitionCount, threadCount);
+        size_t bufferSize = io.alignedCount(
+            distributionBufferElements(M, partitionCount, threadCount),
+            sizeof(int64_t));
+
+        part.runs = partitionCount;
+        part.passes = 1;
+        part.diskReads = onDisk ? (n + bufferSize - 1) / bufferSize : 0;
+        part.peakBufferBytes = totalBuffers * bufferSize * sizeof(int64_t);
+        part.peakTempBytes = n * sizeof(int64_t);
+
+        // An even split gives at most two distinct child sizes; the larger
+        // ones come first, so the first child sees the most live files.
+        size_t small = n / partitionCount;
+        size_t largeCount = n % partitionCount;
+        bool first = true;
+        for (size_t size : {small + 1, small}) {
+          size_t count = size == small ? partitionCount - largeCount
+                                       : largeCount;
+          if (count == 0 || size == 0) continue;
+
+          part.diskWrites += count * ((size + bufferSize - 1) / bufferSize);
+
+          size_t needed = (2 * size * sizeof(int64_t) + M - 1) / M;
+          size_t childArity =
+              std::min(effective_a, std::max(size_t(2), needed));
+          SortExplanation child = visit(size, childArity, true);
+
+          part.diskReads += count * child.diskReads;
+          part.diskWrites += count * child.diskWrites;
+          part.passes = std::max(part.passes, child.passes + 1);
+          part.peakBufferBytes =
+              std::max(part.peakBufferBytes, child.peakBufferBytes);
+          if (first) {
+            part.peakTempBytes += child.peakTempBytes;
+            first = false;
+          }
+        }
+        return part;
+      };
+
+  return visit(N, a, false);
+}
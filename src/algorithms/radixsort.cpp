@@ -0,0 +1,353 @@
+#include "algorithms/radixsort.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "algorithms/lsd_radix_sort.h"
+#include "utils/aligned_buffer_pool.h"
+#include "utils/file_handler.h"
+#include "utils/partition_writer.h"
+#include "utils/sort_parameters.h"
+#include "utils/sort_planner.h"
+
+RadixSort::BucketInput RadixSort::fileInput(const std::string& path) {
+  auto file = std::make_shared<IoContext::File>(io.open(path, OpenMode::Read));
+
+  size_t size = file->size() / sizeof(int64_t);
+  return {size, [file](size_t offset, int64_t* dest, size_t count) {
+            return file->read(offset * sizeof(int64_t), dest,
+                              count * sizeof(int64_t)) /
+                   sizeof(int64_t);
+          }};
+}
+
+RadixSort::BucketInput RadixSort::arrayInput(const int64_t* data,
+                                             size_t size) {
+  return {size,
+          [data, size](size_t offset, int64_t* dest, size_t count) {
+            count = std::min(count, size - std::min(offset, size));
+            std::copy(data + offset, data + offset + count, dest);
+            return count;
+          },
+          data};
+}
+
+uint64_t RadixSort::toUnsigned(int64_t key) {
+  return static_cast<uint64_t>(key) ^ (uint64_t(1) << 63);
+}
+
+size_t RadixSort::bucketBits(size_t a) {
+  size_t bits = 1;
+  while ((size_t(2) << bits) <= a && bits < 16) {
+    bits++;
+  }
+  return bits;
+}
+
+void RadixSort::sortInMemory(int64_t* data, size_t n, size_t M) {
+  // The radix kernel needs a scratch copy, so it is only used when both fit
+  // in M together. The scratch comes from the pool, which counts it against
+  // the sort's budget.
+  if (2 * n * sizeof(int64_t) <= M) {
+    AlignedVector<int64_t> scratch;
+    sortKeys(data, n, scratch);
+  } else {
+    std::sort(data, data + n);
+  }
+}
+
+void RadixSort::distribute(const BucketInput& input,
+                           const BucketOutput& output, size_t outputOffset,
+                           int64_t low, int64_t high, size_t M, size_t bits,
+                           size_t depth) {
+  size_t n = input.size;
+  if (n == 0) {
+    return;
+  }
+
+  if (n * sizeof(int64_t) <= M) {
+    AlignedVector<int64_t> data(n);
+    if (input.read(0, data.data(), n) != n) {
+      throw std::runtime_error("Unexpected end of bucket input");
+    }
+    sortInMemory(data.data(), n, M);
+    output(outputOffset, data.data(), data.size());
+    return;
+  }
+
+  // The bucket is the top bits of the key's offset from low, taken at the
+  // highest bit in which low and high differ.
+  uint64_t base = toUnsigned(low);
+  uint64_t span = toUnsigned(high) - base;
+  size_t width = 0;
+  while (width < 64 && (span >> width) != 0) {
+    width++;
+  }
+  size_t shift = width > bits ? width - bits : 0;
+  size_t bucketCount = size_t(1) << bits;
+  uint64_t lastBucket = bucketCount - 1;
+
+  std::string tempDir = "data/radixsort_temp";
+
+  size_t bufferSize = io.alignedCount(
+      distributionBufferElements(M, bucketCount, 1), sizeof(int64_t));
+
+  std::vector<std::string> files(bucketCount);
+  std::vector<size_t> sizes(bucketCount, 0);
+  std::vector<int64_t> minKeys(bucketCount,
+                               std::numeric_limits<int64_t>::max());
+  std::vector<int64_t> maxKeys(bucketCount,
+                               std::numeric_limits<int64_t>::min());
+
+  for (size_t i = 0; i < bucketCount; i++) {
+    files[i] = tempDir + "/level_" + std::to_string(depth) + "_offset_" +
+               std::to_string(outputOffset) + "_bucket_" + std::to_string(i) +
+               ".bin";
+  }
+  PartitionWriterSet writers(io, files, bufferSize);
+
+  // Keys already in memory are classified in place.
+  AlignedVector<int64_t> readBuffer(input.data != nullptr ? 0 : bufferSize);
+
+  for (size_t position = 0; position < n;) {
+    const int64_t* block = readBuffer.data();
+    size_t elementsRead = std::min(bufferSize, n - position);
+    if (input.data != nullptr) {
+      block = input.data + position;
+    } else {
+      elementsRead = input.read(position, readBuffer.data(), elementsRead);
+      if (elementsRead == 0) {
+        throw std::runtime_error("Unexpected end of bucket input");
+      }
+    }
+    position += elementsRead;
+
+    for (size_t j = 0; j < elementsRead; j++) {
+      int64_t key = block[j];
+      uint64_t value = toUnsigned(key);
+      uint64_t offset = value < base ? 0 : value - base;
+      size_t bucket =
+          static_cast<size_t>(std::min(offset >> shift, lastBucket));
+
+      sizes[bucket]++;
+      minKeys[bucket] = std::min(minKeys[bucket], key);
+      maxKeys[bucket] = std::max(maxKeys[bucket], key);
+      writers.push(bucket, key);
+    }
+  }
+
+  writers.close();
+  AlignedVector<int64_t>().swap(readBuffer);
+
+  // Bucket i starts where the buckets before it end in the output.
+  size_t bucketOffset = outputOffset;
+  for (size_t i = 0; i < bucketCount; i++) {
+    if (sizes[i] == 0) {
+      std::filesystem::remove(files[i]);
+      continue;
+    }
+
+    if (minKeys[i] == maxKeys[i]) {
+      // All keys are equal: the bucket is already sorted.
+      std::vector<int64_t> block(std::min(sizes[i], bufferSize), minKeys[i]);
+      for (size_t done = 0; done < sizes[i];) {
+        size_t count = std::min(sizes[i] - done, block.size());
+        output(bucketOffset + done, block.data(), count);
+        done += count;
+      }
+    } else {
+      // The exact key range of the bucket is known from this pass.
+      distribute(fileInput(files[i]), output, bucketOffset, minKeys[i],
+                 maxKeys[i], M, bits, depth + 1);
+    }
+
+    std::filesystem::remove(files[i]);
+    bucketOffset += sizes[i];
+  }
+}
+
+void RadixSort::sortFile(const std::string& inputPath,
+                         const std::string& outputPath, size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  std::cout << "Running file external radix sort with M=" << M << ", a=" << a
+            << " on " << inputPath << std::endl;
+
+  std::filesystem::create_directories("data/radixsort_temp");
+
+  resetDiskCounters();
+  io.reset();
+
+  // The first pass copies the whole input to bucket files before any
+  // bucket is written back, so the output is created by the first write
+  // and may replace the input file.
+  BucketInput input = fileInput(inputPath);
+  std::unique_ptr<IoContext::File> output;
+  auto create = [this, &output, &outputPath] {
+    output = std::make_unique<IoContext::File>(
+        io.open(outputPath, OpenMode::Write));
+  };
+  BucketOutput write = [&](size_t offset, const int64_t* data,
+                           size_t count) {
+    if (!output) create();
+    output->write(offset * sizeof(int64_t), data, count * sizeof(int64_t));
+  };
+
+  if (input.size == 0) {
+    create();
+    return;
+  }
+
+  // The key range of the file is unknown without a full pass, so the first
+  // pass spreads its buckets over the range of a small random sample; keys
+  // outside it are clamped into the edge buckets. Every later pass knows
+  // the exact range of its bucket.
+  std::mt19937_64 rng(input.size);
+  std::uniform_int_distribution<size_t> position(0, input.size - 1);
+  std::vector<size_t> positions(std::min(input.size, size_t(1024)));
+  for (auto& pos : positions) {
+    pos = position(rng);
+  }
+  std::sort(positions.begin(), positions.end());
+
+  // Samples are taken in position order, reading each block they fall in
+  // once.
+  int64_t low = std::numeric_limits<int64_t>::max();
+  int64_t high = std::numeric_limits<int64_t>::min();
+  std::vector<int64_t> block(INTS_PER_BLOCK);
+  size_t blockStart = std::numeric_limits<size_t>::max();
+  for (size_t pos : positions) {
+    size_t start = pos - pos % INTS_PER_BLOCK;
+    if (start != blockStart) {
+      input.read(start, block.data(),
+                 std::min(INTS_PER_BLOCK, input.size - start));
+      blockStart = start;
+    }
+    low = std::min(low, block[pos - start]);
+    high = std::max(high, block[pos - start]);
+  }
+
+  distribute(input, write, 0, low, high, M, bucketBits(a), 0);
+  if (!output) create();
+}
+
+void RadixSort::sort(std::vector<int64_t>& arr, size_t M, size_t a) {
+  sortView(arr.data(), arr.size(), arr.data(), M, a);
+}
+
+void RadixSort::sortView(const int64_t* input, size_t n, int64_t* output,
+                         size_t M, size_t a) {
+  AlignedBufferPool::SortScope poolScope(M);
+  std::cout << "Running external radix sort with M=" << M << ", a=" << a
+            << " for " << n << " elements" << std::endl;
+
+  std::filesystem::create_directories("data/radixsort_temp");
+
+  resetDiskCounters();
+  io.reset();
+
+  if (n == 0) {
+    return;
+  }
+
+  if (n * sizeof(int64_t) <= M) {
+    if (input != output) {
+      std::copy(input, input + n, output);
+    }
+    sortInMemory(output, n, M);
+    return;
+  }
+
+  auto [minIt, maxIt] = std::minmax_element(input, input + n);
+  int64_t low = *minIt;
+  int64_t high = *maxIt;
+
+  // Every key is copied out to a bucket file before the first sorted bucket
+  // is written back, so input can be source and destination.
+  BucketOutput write = [output](size_t offset, const int64_t* block,
+                                size_t count) {
+    std::copy(block, block + count, output + offset);
+  };
+
+  distribute(arrayInput(input, n), write, 0, low, high, M, bucketBits(a), 0);
+}
+
+void RadixSort::setBlockDevice(std::shared_ptr<BlockDevice> device) {
+  io.setDevice(std::move(device));
+}
+
+void RadixSort::autoSort(std::vector<int64_t>& arr, size_t M) {
+  SortPlan plan = planSort(SortEngine::RadixSort, arr.size(), M,
+                           CostModel::forMachine());
+
+  std::cout << "Auto-tuned parameters: M=" << M << ", " << plan << std::endl;
+
+  sort(arr, M, plan.arity);
+}
+
+SortExplanation RadixSort::explain(size_t N, size_t M, size_t a) const {
+  SortExplanation result{0, 0, 0, 0, 0, 0};
+  if (N == 0) return result;
+
+  if (N * sizeof(int64_t) <= M) {
+    size_t bytes = N * sizeof(int64_t);
+    result.peakBufferBytes = 2 * bytes <= M ? 2 * bytes : bytes;
+    return result;
+  }
+
+  size_t bucketCount = size_t(1) << bucketBits(a);
+  size_t totalBuffers = distributionBuffers(bucketCount, 1);
+  size_t bufferSize = io.alignedCount(
+      distributionBufferElements(M, bucketCount, 1), sizeof(int64_t));
+
+  // Follows distribute on a bucket of n keys. peakTempBytes is the
+  // temporary space the bucket adds on top of its own input file.
+  std::function<SortExplanation(size_t, bool)> visit = [&](size_t n,
+                                                           bool onDisk) {
+    SortExplanation part{0, 0, 0, 0, 0, 0};
+    if (n * sizeof(int64_t) <= M) {
+      size_t bytes = n * sizeof(int64_t);
+      part.diskReads = onDisk ? 1 : 0;
+      part.peakBufferBytes = 2 * bytes <= M ? 2 * bytes : bytes;
+      return part;
+    }
+
+    part.runs = bucketCount;
+    part.passes = 1;
+    part.diskReads = onDisk ? (n + bufferSize - 1) / bufferSize : 0;
+    part.peakBufferBytes = totalBuffers * bufferSize * sizeof(int64_t);
+    part.peakTempBytes = n * sizeof(int64_t);
+
+    // Even buckets have at most two distinct sizes; the larger ones come
+    // first, so the first bucket sees the most live files.
+    size_t small = n / bucketCount;
+    size_t largeCount = n % bucketCount;
+    bool first = true;
+    for (size_t size : {small + 1, small}) {
+      size_t count =
+          size == small ? bucketCount - largeCount : largeCount;
+      if (count == 0 || size == 0) continue;
+
+      part.diskWrites += count * ((size + bufferSize - 1) / bufferSize);
+
+      SortExplanation child = visit(size, true);
+      part.diskReads += count * child.diskReads;
+      part.diskWrites += count * child.diskWrites;
+      part.passes = std::max(part.passes, child.passes + 1);
+      part.peakBufferBytes =
+          std::max(part.peakBufferBytes, child.peakBufferBytes);
+      if (first) {
+        part.peakTempBytes += child.peakTempBytes;
+        first = false;
+      }
+    }
+    return part;
+  };
+
+  return visit(N, false);
+}
@@ -0,0 +1,126 @@
+#include "utils/aligned_buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+AlignedBufferPool::AlignedBufferPool(size_t capacity) : capacity(capacity) {}
+
+AlignedBufferPool::~AlignedBufferPool() { trim(); }
+
+size_t AlignedBufferPool::roundUp(size_t bytes) {
+  bytes = bytes == 0 ? 1 : bytes;
+  return (bytes + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+void AlignedBufferPool::evict(size_t incoming, std::vector<void*>& evicted) {
+  // The largest idle buffers go first, so the fewest are given up.
+  while (!freeBuffers.empty() && idle + live + incoming > capacity) {
+    auto it = std::prev(freeBuffers.end());
+    idle -= it->first;
+    evicted.push_back(it->second);
+    freeBuffers.erase(it);
+  }
+}
+
+void* AlignedBufferPool::acquire(size_t bytes) {
+  size_t size = roundUp(bytes);
+  std::vector<void*> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = freeBuffers.find(size);
+    if (it != freeBuffers.end()) {
+      void* buffer = it->second;
+      freeBuffers.erase(it);
+      idle -= size;
+      live += size;
+      return buffer;
+    }
+    evict(size, evicted);
+    allocated++;
+    live += size;
+    peak = std::max(peak, idle + live);
+  }
+  for (void* buffer : evicted) {
+    std::free(buffer);
+  }
+
+  void* buffer = nullptr;
+  if (posix_memalign(&buffer, BUFFER_ALIGNMENT, size) != 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    live -= size;
+    throw std::bad_alloc();
+  }
+  return buffer;
+}
+
+void AlignedBufferPool::release(void* buffer, size_t bytes) {
+  if (buffer == nullptr) return;
+  size_t size = roundUp(bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    live -= size;
+    if (idle + live + size <= capacity) {
+      freeBuffers.emplace(size, buffer);
+      idle += size;
+      return;
+    }
+  }
+  std::free(buffer);
+}
+
+void AlignedBufferPool::trim() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& entry : freeBuffers) {
+    std::free(entry.second);
+  }
+  freeBuffers.clear();
+  idle = 0;
+}
+
+size_t AlignedBufferPool::setCapacity(size_t bytes) {
+  std::vector<void*> evicted;
+  size_t previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    previous = capacity;
+    capacity = bytes;
+    evict(0, evicted);
+  }
+  for (void* buffer : evicted) {
+    std::free(buffer);
+  }
+  return previous;
+}
+
+size_t AlignedBufferPool::idleBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return idle;
+}
+
+size_t AlignedBufferPool::liveBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return live;
+}
+
+size_t AlignedBufferPool::peakBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return peak;
+}
+
+void AlignedBufferPool::resetPeak() {
+  std::lock_guard<std::mutex> lock(mutex);
+  peak = idle + live;
+}
+
+size_t AlignedBufferPool::allocations() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return allocated;
+}
+
+AlignedBufferPool& AlignedBufferPool::global() {
+  // Never destroyed, so containers that outlive main() can still return
+  // their memory.
+  static AlignedBufferPool* pool = new AlignedBufferPool();
+  return *pool;
+}
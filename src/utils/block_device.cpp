@@ -0,0 +1,338 @@
+#include "utils/block_device.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "utils/aligned_buffer_pool.h"
+
+namespace {
+
+/**
+ * @brief Bytes staged per system call when a direct transfer is not
+ * aligned.
+ */
+constexpr size_t STAGING_BYTES = 256 * 1024;
+
+[[noreturn]] void fail(const char* what, const std::string& path) {
+  throw std::runtime_error(what + path + " (" + std::strerror(errno) + ")");
+}
+
+size_t readAt(int fd, const std::string& path, size_t offset, void* dest,
+              size_t bytes) {
+  char* out = static_cast<char*>(dest);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t got = ::pread(fd, out + done, bytes - done,
+                          static_cast<off_t>(offset + done));
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      fail("Error reading from file: ", path);
+    }
+    if (got == 0) break;
+    done += static_cast<size_t>(got);
+  }
+  return done;
+}
+
+void writeAt(int fd, const std::string& path, size_t offset, const void* src,
+             size_t bytes) {
+  const char* in = static_cast<const char*>(src);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t put = ::pwrite(fd, in + done, bytes - done,
+                           static_cast<off_t>(offset + done));
+    if (put < 0) {
+      if (errno == EINTR) continue;
+      fail("Error writing to file: ", path);
+    }
+    done += static_cast<size_t>(put);
+  }
+}
+
+size_t statSize(int fd, const std::string& path) {
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    fail("Could not stat file: ", path);
+  }
+  return static_cast<size_t>(info.st_size);
+}
+
+class PosixBlockFile : public BlockFile {
+ public:
+  PosixBlockFile(int fd, const std::string& path) : fd(fd), path(path) {}
+
+  ~PosixBlockFile() override { ::close(fd); }
+
+  PosixBlockFile(const PosixBlockFile&) = delete;
+  PosixBlockFile& operator=(const PosixBlockFile&) = delete;
+
+  size_t read(size_t offset, void* dest, size_t bytes) override {
+    return readAt(fd, path, offset, dest, bytes);
+  }
+
+  void write(size_t offset, const void* src, size_t bytes) override {
+    writeAt(fd, path, offset, src, bytes);
+  }
+
+  void append(const void* src, size_t bytes) override {
+    const char* in = static_cast<const char*>(src);
+    size_t done = 0;
+    while (done < bytes) {
+      ssize_t put = ::write(fd, in + done, bytes - done);
+      if (put < 0) {
+        if (errno == EINTR) continue;
+        fail("Error appending to file: ", path);
+      }
+      done += static_cast<size_t>(put);
+    }
+  }
+
+  size_t size() const override { return statSize(fd, path); }
+
+  int descriptor() const override { return fd; }
+
+ private:
+  int fd;
+  std::string path;
+};
+
+/**
+ * @brief A buffer of the global AlignedBufferPool, returned on destruction.
+ */
+class PoolBuffer {
+ public:
+  explicit PoolBuffer(size_t bytes) : bytes(bytes) {
+    buffer = static_cast<char*>(AlignedBufferPool::global().acquire(bytes));
+  }
+  ~PoolBuffer() { AlignedBufferPool::global().release(buffer, bytes); }
+
+  PoolBuffer(const PoolBuffer&) = delete;
+  PoolBuffer& operator=(const PoolBuffer&) = delete;
+
+  char* data() { return buffer; }
+
+ private:
+  size_t bytes;
+  char* buffer;
+};
+
+bool isAligned(size_t value) { return value % BUFFER_ALIGNMENT == 0; }
+
+size_t alignDown(size_t value) {
+  return value / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+size_t alignUp(size_t value) {
+  return alignDown(value + BUFFER_ALIGNMENT - 1);
+}
+
+/**
+ * @brief A file opened with O_DIRECT.
+ *
+ * Aligned transfers go straight between the caller's buffer and the disk.
+ * Others are staged through pool buffers a whole number of blocks long:
+ * reads fetch the covering blocks and copy the requested bytes out, writes
+ * read back the partial blocks at either end, patch them and write whole
+ * blocks. The file is then truncated to its logical size, so a file never
+ * keeps the padding of its unaligned tail. The block holding that tail is
+ * cached, so sequential unaligned writes never read the disk.
+ */
+class DirectBlockFile : public BlockFile {
+ public:
+  DirectBlockFile(int fd, const std::string& path)
+      : fd(fd), path(path), tail(BUFFER_ALIGNMENT) {
+    logical = statSize(fd, path);
+  }
+
+  ~DirectBlockFile() override { ::close(fd); }
+
+  DirectBlockFile(const DirectBlockFile&) = delete;
+  DirectBlockFile& operator=(const DirectBlockFile&) = delete;
+
+  size_t read(size_t offset, void* dest, size_t bytes) override {
+    size_t end = logical;
+    if (offset >= end) return 0;
+    bytes = std::min(bytes, end - offset);
+
+    char* out = static_cast<char*>(dest);
+    if (isAligned(offset) && isAligned(bytes) &&
+        isAligned(reinterpret_cast<uintptr_t>(out))) {
+      return readAt(fd, path, offset, out, bytes);
+    }
+
+    PoolBuffer staging(STAGING_BYTES);
+    size_t done = 0;
+    while (done < bytes) {
+      size_t position = offset + done;
+      size_t start = alignDown(position);
+      size_t span = std::min(STAGING_BYTES, alignUp(offset + bytes) - start);
+      size_t got = readAt(fd, path, start, staging.data(), span);
+      size_t skip = position - start;
+      if (got <= skip) break;
+      size_t count = std::min(got - skip, bytes - done);
+      std::memcpy(out + done, staging.data() + skip, count);
+      done += count;
+      if (got < span) break;
+    }
+    return done;
+  }
+
+  void write(size_t offset, const void* src, size_t bytes) override {
+    if (bytes == 0) return;
+    const char* in = static_cast<const char*>(src);
+    size_t end = offset + bytes;
+
+    if (isAligned(offset) && isAligned(bytes) &&
+        isAligned(reinterpret_cast<uintptr_t>(in))) {
+      // Whole blocks share no block with any other writer of a disjoint
+      // range; only the logical size needs the lock.
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (end > logical) {
+          logical = end;
+          tailValid = false;
+        }
+      }
+      writeAt(fd, path, offset, in, bytes);
+      return;
+    }
+
+    // Writers of neighbouring ranges may patch the same block, so staged
+    // writes are serialized.
+    std::lock_guard<std::mutex> lock(mutex);
+    PoolBuffer staging(STAGING_BYTES);
+    size_t done = 0;
+    size_t written = 0;
+    while (done < bytes) {
+      size_t position = offset + done;
+      size_t start = alignDown(position);
+      size_t span = std::min(STAGING_BYTES, alignUp(end) - start);
+      size_t count = std::min(span - (position - start), bytes - done);
+      size_t last = start + span - BUFFER_ALIGNMENT;
+
+      if (position > start) {
+        fillBlock(staging.data(), start);
+      }
+      if (position + count < start + span &&
+          (last != start || position == start)) {
+        fillBlock(staging.data() + (last - start), last);
+      }
+      std::memcpy(staging.data() + (position - start), in + done, count);
+      writeAt(fd, path, start, staging.data(), span);
+      written = std::max(written, start + span);
+
+      size_t size = logical;
+      size = std::max(size, position + count);
+      logical = size;
+      if (isAligned(size)) {
+        tailValid = false;
+      } else if (alignDown(size) >= start && alignDown(size) <= last) {
+        std::memcpy(tail.data(), staging.data() + (alignDown(size) - start),
+                    BUFFER_ALIGNMENT);
+        tailValid = true;
+      }
+      done += count;
+    }
+
+    if (written > logical &&
+        ::ftruncate(fd, static_cast<off_t>(logical.load())) != 0) {
+      fail("Could not truncate file: ", path);
+    }
+  }
+
+  void append(const void* src, size_t bytes) override {
+    write(logical, src, bytes);
+  }
+
+  size_t size() const override { return logical; }
+
+ private:
+  /**
+   * @brief Copies the current contents of the block at start into dest,
+   * zero-filled past the end of the file. Called with the lock held.
+   */
+  void fillBlock(char* dest, size_t start) {
+    size_t size = logical;
+    if (start >= size) {
+      std::memset(dest, 0, BUFFER_ALIGNMENT);
+      return;
+    }
+    if (tailValid && start == alignDown(size)) {
+      std::memcpy(dest, tail.data(), BUFFER_ALIGNMENT);
+      return;
+    }
+    size_t got = readAt(fd, path, start, dest, BUFFER_ALIGNMENT);
+    std::memset(dest + got, 0, BUFFER_ALIGNMENT - got);
+  }
+
+  int fd;
+  std::string path;
+  std::atomic<size_t> logical{0};
+  std::mutex mutex;
+  PoolBuffer tail;
+  bool tailValid = false;
+};
+
+int openFlags(OpenMode mode) {
+  switch (mode) {
+    case OpenMode::Read:
+      return O_RDONLY;
+    case OpenMode::Write:
+      return O_RDWR | O_CREAT | O_TRUNC;
+    case OpenMode::Update:
+      return O_RDWR | O_CREAT;
+    case OpenMode::Append:
+      return O_WRONLY | O_CREAT | O_APPEND;
+  }
+  return O_RDONLY;
+}
+
+}  // namespace
+
+std::unique_ptr<BlockFile> PosixBlockDevice::open(const std::string& path,
+                                                  OpenMode mode) {
+  int fd = ::open(path.c_str(), openFlags(mode) | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fail("Could not open file: ", path);
+  }
+  return std::make_unique<PosixBlockFile>(fd, path);
+}
+
+std::unique_ptr<BlockFile> DirectBlockDevice::open(const std::string& path,
+                                                   OpenMode mode) {
+  // Appends are positional writes at the logical end, and staged writes
+  // read back partial blocks, so writable files are opened read-write.
+  int flags = mode == OpenMode::Read ? O_RDONLY : O_RDWR | O_CREAT;
+  if (mode == OpenMode::Write) {
+    flags |= O_TRUNC;
+  }
+#ifdef O_DIRECT
+  flags |= O_DIRECT;
+#endif
+
+  int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    if (errno == EINVAL) {
+      fail("Direct I/O is not supported for file: ", path);
+    }
+    fail("Could not open file: ", path);
+  }
+  return std::make_unique<DirectBlockFile>(fd, path);
+}
+
+size_t DirectBlockDevice::alignment() const { return BUFFER_ALIGNMENT; }
+
+std::shared_ptr<BlockDevice> defaultBlockDevice() {
+  static std::shared_ptr<BlockDevice> device =
+      std::make_shared<PosixBlockDevice>();
+  return device;
+}
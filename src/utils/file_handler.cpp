@@ -1,12 +1,11 @@
 #include "utils/file_handler.h"
 
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <stdexcept>
 
-size_t disk_read_count = 0;
-size_t disk_write_count = 0;
+std::atomic<size_t> disk_read_count{0};
+std::atomic<size_t> disk_write_count{0};
 
 void resetDiskCounters() {
   disk_read_count = 0;
@@ -25,168 +24,99 @@ void ensureDirectoryExists(const std::string& filepath) {
   }
 }
 
-std::vector<int> readFromFile(const std::string& filename) {
-  std::ifstream file(filename, std::ios::binary);
+namespace {
 
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file: " + filename);
-  }
-
-  file.seekg(0, std::ios::end);
-  std::streamsize size = file.tellg();
-  file.seekg(0, std::ios::beg);
+template <typename T>
+std::vector<T> readWholeFile(const std::string& filename, IoContext& io) {
+  IoContext::File file = io.open(filename, OpenMode::Read);
 
-  size_t numIntegers = size / sizeof(int);
-  std::vector<int> data(numIntegers);
+  size_t size = file.size();
+  std::vector<T> data(size / sizeof(T));
+  size_t bytes = data.size() * sizeof(T);
 
-  if (!file.read(reinterpret_cast<char*>(data.data()), size)) {
+  if (file.read(0, data.data(), bytes) != bytes) {
     throw std::runtime_error("Error reading from file: " + filename);
   }
 
-  disk_read_count++;
-
   return data;
 }
 
-std::vector<int> readDataFromFile(const std::string& filename) {
-  return readFromFile(filename);
-}
-
-void writeToFile(const std::string& filename, const std::vector<int>& data) {
+template <typename T>
+void writeWholeFile(const std::string& filename, const std::vector<T>& data,
+                    IoContext& io) {
   ensureDirectoryExists(filename);
 
-  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file for writing: " + filename);
-  }
+  IoContext::File file = io.open(filename, OpenMode::Write);
+  file.write(0, data.data(), data.size() * sizeof(T));
+}
 
-  if (!file.write(reinterpret_cast<const char*>(data.data()),
-                  data.size() * sizeof(int))) {
-    throw std::runtime_error("Error writing to file: " + filename);
-  }
+}  // namespace
 
-  disk_write_count++;
+std::vector<int> readFromFile(const std::string& filename, IoContext& io) {
+  return readWholeFile<int>(filename, io);
 }
 
-void writeDataToFile(const std::string& filename,
-                     const std::vector<int>& data) {
-  writeToFile(filename, data);
+std::vector<int> readDataFromFile(const std::string& filename,
+                                  IoContext& io) {
+  return readFromFile(filename, io);
 }
 
-std::vector<int64_t> readInt64FromFile(const std::string& filename) {
-  std::ifstream file(filename, std::ios::binary);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file: " + filename);
-  }
-
-  file.seekg(0, std::ios::end);
-  std::streamsize size = file.tellg();
-  file.seekg(0, std::ios::beg);
-
-  size_t numIntegers = size / sizeof(int64_t);
-  std::vector<int64_t> data(numIntegers);
-
-  if (!file.read(reinterpret_cast<char*>(data.data()), size)) {
-    throw std::runtime_error("Error reading from file: " + filename);
-  }
+void writeToFile(const std::string& filename, const std::vector<int>& data,
+                 IoContext& io) {
+  writeWholeFile(filename, data, io);
+}
 
-  disk_read_count++;
+void writeDataToFile(const std::string& filename, const std::vector<int>& data,
+                     IoContext& io) {
+  writeToFile(filename, data, io);
+}
 
-  return data;
+std::vector<int64_t> readInt64FromFile(const std::string& filename,
+                                       IoContext& io) {
+  return readWholeFile<int64_t>(filename, io);
 }
 
-std::vector<int64_t> readInt64DataFromFile(const std::string& filename) {
-  return readInt64FromFile(filename);
+std::vector<int64_t> readInt64DataFromFile(const std::string& filename,
+                                           IoContext& io) {
+  return readInt64FromFile(filename, io);
 }
 
 void writeInt64ToFile(const std::string& filename,
-                      const std::vector<int64_t>& data) {
-  ensureDirectoryExists(filename);
-
-  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file for writing: " + filename);
-  }
-
-  if (!file.write(reinterpret_cast<const char*>(data.data()),
-                  data.size() * sizeof(int64_t))) {
-    throw std::runtime_error("Error writing to file: " + filename);
-  }
-
-  disk_write_count++;
+                      const std::vector<int64_t>& data, IoContext& io) {
+  writeWholeFile(filename, data, io);
 }
 
 void writeInt64DataToFile(const std::vector<int64_t>& data,
-                          const std::string& filename) {
-  writeInt64ToFile(filename, data);
+                          const std::string& filename, IoContext& io) {
+  writeInt64ToFile(filename, data, io);
 }
 
 std::vector<int64_t> readBlockFromFile(const std::string& filename,
-                                       size_t offset, size_t blockSize) {
-  std::ifstream file(filename, std::ios::binary);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file: " + filename);
-  }
-
-  file.seekg(offset, std::ios::beg);
+                                       size_t offset, size_t blockSize,
+                                       IoContext& io) {
+  IoContext::File file = io.open(filename, OpenMode::Read);
 
   size_t maxElements = blockSize / sizeof(int64_t);
   std::vector<int64_t> block(maxElements);
 
-  file.read(reinterpret_cast<char*>(block.data()), blockSize);
-
-  size_t elementsRead = file.gcount() / sizeof(int64_t);
-  block.resize(elementsRead);
-
-  disk_read_count++;
+  size_t bytesRead =
+      file.read(offset, block.data(), maxElements * sizeof(int64_t));
+  block.resize(bytesRead / sizeof(int64_t));
 
   return block;
 }
 
 void writeBlockToFile(const std::string& filename,
-                      const std::vector<int64_t>& block, size_t offset) {
+                      const std::vector<int64_t>& block, size_t offset,
+                      IoContext& io) {
   ensureDirectoryExists(filename);
 
-  std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
-
-  if (!file.is_open()) {
-    std::ofstream newFile(filename, std::ios::binary);
-    newFile.close();
-
-    file.open(filename, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file.is_open()) {
-      throw std::runtime_error("Could not create file: " + filename);
-    }
-  }
-
-  file.seekp(offset, std::ios::beg);
-
-  file.write(reinterpret_cast<const char*>(block.data()),
-             block.size() * sizeof(int64_t));
-
-  if (!file) {
-    throw std::runtime_error("Error writing to file: " + filename);
-  }
-
-  disk_write_count++;
+  IoContext::File file = io.open(filename, OpenMode::Update);
+  file.write(offset, block.data(), block.size() * sizeof(int64_t));
 }
 
 void appendInt64DataToFile(const std::vector<int64_t>& data,
-                           const std::string& filename) {
-  std::ofstream file(filename, std::ios::binary | std::ios::app);
-
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open file for appending: " + filename);
-  }
-
-  if (!file.write(reinterpret_cast<const char*>(data.data()),
-                  data.size() * sizeof(int64_t))) {
-    throw std::runtime_error("Error appending to file: " + filename);
-  }
-
-  disk_write_count++;
-}
\ No newline at end of file
+                           const std::string& filename, IoContext& io) {
+  IoContext::File file = io.open(filename, OpenMode::Append);
+  file.append(data.data(), data.size() * sizeof(int64_t));
+}
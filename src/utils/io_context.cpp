@@ -0,0 +1,104 @@
+#include "utils/io_context.h"
+
+#include <algorithm>
+
+#include "utils/file_handler.h"
+
+namespace {
+
+size_t blocksSpanned(size_t offset, size_t bytes) {
+  return (offset + bytes - 1) / IO_BLOCK_SIZE - offset / IO_BLOCK_SIZE + 1;
+}
+
+}  // namespace
+
+IoContext::File::File(IoContext& io, std::unique_ptr<BlockFile> file,
+                      size_t end)
+    : io(&io), file(std::move(file)), end(end) {}
+
+size_t IoContext::File::read(size_t offset, void* dest, size_t bytes) {
+  size_t got = file->read(offset, dest, bytes);
+  io->recordRead(offset, got);
+  return got;
+}
+
+void IoContext::File::write(size_t offset, const void* src, size_t bytes) {
+  file->write(offset, src, bytes);
+  io->recordWrite(offset, bytes);
+}
+
+void IoContext::File::append(const void* src, size_t bytes) {
+  file->append(src, bytes);
+  io->recordWrite(end, bytes);
+  end += bytes;
+}
+
+IoContext::IoContext(std::shared_ptr<BlockDevice> device) {
+  setDevice(std::move(device));
+}
+
+IoContext::File IoContext::open(const std::string& path, OpenMode mode) {
+  std::unique_ptr<BlockFile> file = blockDevice->open(path, mode);
+  size_t end = mode == OpenMode::Append ? file->size() : 0;
+  return File(*this, std::move(file), end);
+}
+
+void IoContext::setDevice(std::shared_ptr<BlockDevice> device) {
+  blockDevice = device ? std::move(device) : defaultBlockDevice();
+}
+
+size_t IoContext::alignedCount(size_t count, size_t elementSize) const {
+  size_t unit = std::max(size_t(1), blockDevice->alignment() / elementSize);
+  return count < unit ? count : count / unit * unit;
+}
+
+void IoContext::setQueue(size_t depth, IoQueueKind kind) {
+  this->depth = std::max(size_t(1), depth);
+  queueKind = kind;
+}
+
+std::unique_ptr<IoQueue> IoContext::createQueue() {
+  return IoQueue::create(depth, queueKind, this);
+}
+
+void IoContext::recordRead(size_t offset, size_t bytes) {
+  if (bytes == 0) return;
+  readRequests++;
+  bytesRead += bytes;
+  blocksRead += blocksSpanned(offset, bytes);
+  disk_read_count++;
+}
+
+void IoContext::recordWrite(size_t offset, size_t bytes) {
+  if (bytes == 0) return;
+  writeRequests++;
+  bytesWritten += bytes;
+  blocksWritten += blocksSpanned(offset, bytes);
+  disk_write_count++;
+}
+
+IoStats IoContext::stats() const {
+  return {readRequests, writeRequests, bytesRead,
+          bytesWritten, blocksRead,    blocksWritten};
+}
+
+void IoContext::reset() {
+  readRequests = 0;
+  writeRequests = 0;
+  bytesRead = 0;
+  bytesWritten = 0;
+  blocksRead = 0;
+  blocksWritten = 0;
+}
+
+IoContext& IoContext::global() {
+  static IoContext context;
+  return context;
+}
+
+std::ostream& operator<<(std::ostream& out, const IoStats& stats) {
+  return out << "reads " << stats.readRequests << " (" << stats.bytesRead
+             << " bytes, " << stats.blocksRead << " blocks), writes "
+             << stats.writeRequests << " (" << stats.bytesWritten
+             << " bytes, " << stats.blocksWritten << " blocks)";
+}
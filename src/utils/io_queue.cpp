@@ -0,0 +1,483 @@
+#include "utils/io_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <map>
+#include <stdexcept>
+
+#include "utils/io_context.h"
+#include "utils/thread_pool.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define SORTING_HAVE_IO_URING 1
+#endif
+
+IoQueue::IoQueue(size_t depth, IoContext* io)
+    : queueDepth(std::max(size_t(1), depth)), io(io) {}
+
+size_t IoQueue::read(BlockFile& file, size_t offset, void* dest,
+                     size_t bytes) {
+  return submitRequest({&file, offset, dest, bytes, false});
+}
+
+size_t IoQueue::write(BlockFile& file, size_t offset, const void* src,
+                      size_t bytes) {
+  return submitRequest(
+      {&file, offset, const_cast<void*>(src), bytes, true});
+}
+
+size_t IoQueue::submitRequest(const Request& request) {
+  if (outstanding() >= queueDepth) {
+    submit();
+    waitAny();
+  }
+
+  size_t ticket = nextTicket++;
+  requests.emplace(ticket, request);
+  enqueue(ticket, request);
+  return ticket;
+}
+
+size_t IoQueue::wait(size_t ticket) {
+  auto it = requests.find(ticket);
+  if (it == requests.end()) {
+    throw std::runtime_error("Unknown I/O ticket " + std::to_string(ticket));
+  }
+  Request request = it->second;
+  requests.erase(it);
+
+  size_t bytes = complete(ticket);
+  if (io != nullptr) {
+    if (request.write) {
+      io->recordWrite(request.offset, bytes);
+    } else {
+      io->recordRead(request.offset, bytes);
+    }
+  }
+  return bytes;
+}
+
+bool IoQueue::registerBuffers(
+    const std::vector<std::pair<void*, size_t>>& /*buffers*/) {
+  return false;
+}
+
+bool IoQueue::registerFiles(const std::vector<BlockFile*>& /*files*/) {
+  return false;
+}
+
+size_t IoQueue::finish(const Request& request, size_t done) {
+  char* data = static_cast<char*>(request.data);
+  if (request.write) {
+    request.file->write(request.offset + done, data + done,
+                        request.bytes - done);
+    return request.bytes;
+  }
+  return done + request.file->read(request.offset + done, data + done,
+                                   request.bytes - done);
+}
+
+namespace {
+
+/**
+ * @brief Portable backend: each submitted request is a pread or pwrite on
+ * one of depth() worker threads.
+ */
+class ThreadPoolIoQueue : public IoQueue {
+ public:
+  ThreadPoolIoQueue(size_t depth, IoContext* io)
+      : IoQueue(depth, io), pool(this->depth()) {}
+
+  std::string name() const override { return "threads"; }
+
+  void submit() override {
+    for (size_t ticket : pending) {
+      Slot& slot = slots.at(ticket);
+      slot.done =
+          pool.submit([&slot] { slot.bytes = finish(slot.request, 0); });
+      inFlight.push_back(ticket);
+    }
+    pending.clear();
+  }
+
+ protected:
+  void enqueue(size_t ticket, const Request& request) override {
+    slots[ticket].request = request;
+    pending.push_back(ticket);
+  }
+
+  void waitAny() override {
+    if (inFlight.empty()) return;
+    size_t ticket = inFlight.front();
+    inFlight.pop_front();
+    slots.at(ticket).done.wait();
+  }
+
+  size_t complete(size_t ticket) override {
+    if (std::find(pending.begin(), pending.end(), ticket) != pending.end()) {
+      submit();
+    }
+    auto inFlightIt = std::find(inFlight.begin(), inFlight.end(), ticket);
+    if (inFlightIt != inFlight.end()) {
+      inFlight.erase(inFlightIt);
+    }
+
+    auto it = slots.find(ticket);
+    it->second.done.get();
+    size_t bytes = it->second.bytes;
+    slots.erase(it);
+    return bytes;
+  }
+
+  size_t outstanding() const override {
+    return pending.size() + inFlight.size();
+  }
+
+ private:
+  struct Slot {
+    Request request;
+    std::future<void> done;
+    size_t bytes = 0;
+  };
+
+  // Declared before the pool, which is joined first on destruction.
+  std::unordered_map<size_t, Slot> slots;
+  std::vector<size_t> pending;
+  std::deque<size_t> inFlight;
+  ThreadPool pool;
+};
+
+#ifdef SORTING_HAVE_IO_URING
+
+/**
+ * @brief io_uring backend on the raw system calls. submit() places every
+ * queued request in the submission ring and issues them with a single
+ * io_uring_enter; completions are reaped from the completion ring.
+ */
+class UringIoQueue : public IoQueue {
+ public:
+  /**
+   * @brief Returns a ring of the given depth, or null when the kernel does
+   * not offer io_uring (too old, disabled or filtered by seccomp).
+   */
+  static std::unique_ptr<IoQueue> tryCreate(size_t depth, IoContext* io) {
+    std::unique_ptr<UringIoQueue> queue(new UringIoQueue(depth, io));
+    if (!queue->setup()) return nullptr;
+    return queue;
+  }
+
+  ~UringIoQueue() override {
+    // The kernel may still write into caller buffers until every request
+    // in flight completes.
+    try {
+      while (inFlight > 0) {
+        if (reap() == 0) enter(0, 1);
+      }
+    } catch (const std::exception&) {
+    }
+    if (sqes != nullptr) munmap(sqes, sqesSize);
+    if (cqRing != nullptr && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != nullptr) munmap(sqRing, sqRingSize);
+    if (ringFd >= 0) close(ringFd);
+  }
+
+  std::string name() const override { return "io_uring"; }
+
+  void submit() override {
+    if (pending.empty()) return;
+
+    unsigned tail = *sqTail;
+    for (const auto& entry : pending) {
+      unsigned index = tail & *sqMask;
+      prepare(sqes[index], entry.first, entry.second);
+      sqArray[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    size_t count = pending.size();
+    pending.clear();
+    inFlight += count;
+    while (count > 0) {
+      count -= enter(static_cast<unsigned>(count), 0);
+    }
+  }
+
+  bool registerBuffers(
+      const std::vector<std::pair<void*, size_t>>& regions) override {
+    if (!buffers.empty()) {
+      syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_BUFFERS,
+              nullptr, 0);
+      buffers.clear();
+    }
+
+    std::vector<iovec> iov;
+    for (const auto& region : regions) {
+      if (region.first == nullptr || region.second == 0) continue;
+      iov.push_back({region.first, region.second});
+    }
+    if (iov.empty()) return false;
+
+    // Pinning may exceed RLIMIT_MEMLOCK; plain requests still work then.
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS,
+                iov.data(), static_cast<unsigned>(iov.size())) < 0) {
+      return false;
+    }
+    for (size_t i = 0; i < iov.size(); i++) {
+      uintptr_t begin = reinterpret_cast<uintptr_t>(iov[i].iov_base);
+      buffers[begin] = {begin + iov[i].iov_len, static_cast<unsigned>(i)};
+    }
+    return true;
+  }
+
+  bool registerFiles(const std::vector<BlockFile*>& files) override {
+    if (!fixedFiles.empty()) {
+      syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_FILES,
+              nullptr, 0);
+      fixedFiles.clear();
+    }
+
+    std::vector<int> descriptors;
+    std::vector<BlockFile*> registered;
+    for (BlockFile* file : files) {
+      if (file->descriptor() < 0) continue;
+      descriptors.push_back(file->descriptor());
+      registered.push_back(file);
+    }
+    if (descriptors.empty()) return false;
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES,
+                descriptors.data(),
+                static_cast<unsigned>(descriptors.size())) < 0) {
+      return false;
+    }
+    for (size_t i = 0; i < registered.size(); i++) {
+      fixedFiles[registered[i]] = static_cast<unsigned>(i);
+    }
+    return true;
+  }
+
+ protected:
+  void enqueue(size_t ticket, const Request& request) override {
+    if (request.file->descriptor() < 0) {
+      // Files without a descriptor are served synchronously.
+      synchronous[ticket] = finish(request, 0);
+      return;
+    }
+    active[ticket] = request;
+    pending.push_back({ticket, request});
+  }
+
+  void waitAny() override {
+    submit();
+    if (inFlight == 0) return;
+    while (reap() == 0) {
+      enter(0, 1);
+    }
+  }
+
+  size_t complete(size_t ticket) override {
+    auto sync = synchronous.find(ticket);
+    if (sync != synchronous.end()) {
+      size_t bytes = sync->second;
+      synchronous.erase(sync);
+      return bytes;
+    }
+
+    for (const auto& entry : pending) {
+      if (entry.first == ticket) {
+        submit();
+        break;
+      }
+    }
+    while (results.find(ticket) == results.end()) {
+      if (reap() == 0) enter(0, 1);
+    }
+
+    int result = results[ticket];
+    results.erase(ticket);
+    Request request = active[ticket];
+    active.erase(ticket);
+
+    if (result < 0) {
+      throw std::runtime_error(
+          std::string(request.write ? "Error writing" : "Error reading") +
+          " with io_uring: " + std::strerror(-result));
+    }
+    size_t done = static_cast<size_t>(result);
+    return done < request.bytes ? finish(request, done) : done;
+  }
+
+  size_t outstanding() const override { return pending.size() + inFlight; }
+
+ private:
+  /**
+   * @brief Largest transfer of one submission entry; longer requests are
+   * completed by finish().
+   */
+  static constexpr size_t MAX_ENTRY_BYTES = size_t(1) << 30;
+
+  UringIoQueue(size_t depth, IoContext* io) : IoQueue(depth, io) {}
+
+  bool setup() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup,
+                                      static_cast<unsigned>(depth()),
+                                      &params));
+    if (ringFd < 0) return false;
+
+    // IORING_OP_READ and IORING_OP_WRITE need 5.6; FAST_POLL marks 5.7.
+    if (!(params.features & IORING_FEAT_FAST_POLL)) return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+    if (sqRing == nullptr) return false;
+    cqRing = single ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+    if (cqRing == nullptr) return false;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+    if (sqes == nullptr) return false;
+
+    char* sq = static_cast<char*>(sqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* map(size_t size, off_t offset) {
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, offset);
+    return ring == MAP_FAILED ? nullptr : ring;
+  }
+
+  void prepare(io_uring_sqe& sqe, size_t ticket, const Request& request) {
+    std::memset(&sqe, 0, sizeof(sqe));
+    size_t bytes = std::min(request.bytes, MAX_ENTRY_BYTES);
+    uintptr_t address = reinterpret_cast<uintptr_t>(request.data);
+
+    sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe.fd = request.file->descriptor();
+    sqe.off = request.offset;
+    sqe.addr = address;
+    sqe.len = static_cast<unsigned>(bytes);
+    sqe.user_data = ticket;
+
+    auto file = fixedFiles.find(request.file);
+    if (file != fixedFiles.end()) {
+      sqe.fd = static_cast<int>(file->second);
+      sqe.flags |= IOSQE_FIXED_FILE;
+    }
+
+    auto buffer = buffers.upper_bound(address);
+    if (buffer != buffers.begin()) {
+      --buffer;
+      if (address + bytes <= buffer->second.first) {
+        sqe.opcode =
+            request.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe.buf_index = static_cast<uint16_t>(buffer->second.second);
+      }
+    }
+  }
+
+  /**
+   * @brief Calls io_uring_enter, retrying on signals.
+   * @return The number of entries the kernel consumed.
+   */
+  size_t enter(unsigned toSubmit, unsigned minComplete) {
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+      long consumed = syscall(__NR_io_uring_enter, ringFd, toSubmit,
+                              minComplete, flags, nullptr, 0);
+      if (consumed >= 0) return static_cast<size_t>(consumed);
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN || errno == EBUSY) && toSubmit > 0) {
+        // The completion ring is full: reap before submitting more.
+        reap();
+        continue;
+      }
+      throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                               std::strerror(errno));
+    }
+  }
+
+  /**
+   * @brief Moves completions from the ring to results.
+   * @return The number of completions reaped.
+   */
+  size_t reap() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+    for (; head != tail; head++, count++) {
+      const io_uring_cqe& cqe = cqes[head & *cqMask];
+      results[cqe.user_data] = cqe.res;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    inFlight -= count;
+    return count;
+  }
+
+  int ringFd = -1;
+  void* sqRing = nullptr;
+  void* cqRing = nullptr;
+  size_t sqRingSize = 0;
+  size_t cqRingSize = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqesSize = 0;
+  unsigned* sqTail = nullptr;
+  unsigned* sqMask = nullptr;
+  unsigned* sqArray = nullptr;
+  unsigned* cqHead = nullptr;
+  unsigned* cqTail = nullptr;
+  unsigned* cqMask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+
+  std::vector<std::pair<size_t, Request>> pending;
+  size_t inFlight = 0;
+  std::unordered_map<size_t, Request> active;
+  std::unordered_map<size_t, int> results;
+  std::unordered_map<size_t, size_t> synchronous;
+  // Registered buffers by start address: (end address, index).
+  std::map<uintptr_t, std::pair<uintptr_t, unsigned>> buffers;
+  std::unordered_map<const BlockFile*, unsigned> fixedFiles;
+};
+
+#endif  // SORTING_HAVE_IO_URING
+
+}  // namespace
+
+std::unique_ptr<IoQueue> IoQueue::create(size_t depth, IoQueueKind kind,
+                                         IoContext* io) {
+#ifdef SORTING_HAVE_IO_URING
+  if (kind != IoQueueKind::ThreadPool) {
+    std::unique_ptr<IoQueue> queue = UringIoQueue::tryCreate(depth, io);
+    if (queue) return queue;
+  }
+#else
+  (void)kind;
+#endif
+  return std::make_unique<ThreadPoolIoQueue>(depth, io);
+}
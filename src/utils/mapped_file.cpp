@@ -0,0 +1,159 @@
+#include "utils/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Size of a transparent huge page on x86-64 and most arm64 kernels.
+ */
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+[[noreturn]] void fail(const char* what, const std::string& path) {
+  throw std::runtime_error(what + path + " (" + std::strerror(errno) + ")");
+}
+
+int adviceFor(AccessPattern pattern) {
+  switch (pattern) {
+    case AccessPattern::Sequential:
+      return MADV_SEQUENTIAL;
+    case AccessPattern::Random:
+      return MADV_RANDOM;
+    case AccessPattern::Normal:
+      break;
+  }
+  return MADV_NORMAL;
+}
+
+/**
+ * @brief Reserves address space for bytes bytes starting on a huge-page
+ * boundary, or returns null if it cannot.
+ */
+void* reserveAligned(size_t bytes) {
+  size_t span = bytes + HUGE_PAGE_SIZE;
+  void* area = ::mmap(nullptr, span, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (area == MAP_FAILED) return nullptr;
+
+  char* start = static_cast<char*>(area);
+  uintptr_t address = reinterpret_cast<uintptr_t>(start);
+  char* aligned = start + (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) %
+                              HUGE_PAGE_SIZE;
+
+  // The file is mapped over [aligned, aligned + bytes); the rest of the
+  // reservation is given back.
+  size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t used = (bytes + pageSize - 1) / pageSize * pageSize;
+  if (aligned > start) {
+    ::munmap(start, static_cast<size_t>(aligned - start));
+  }
+  char* end = start + span;
+  if (aligned + used < end) {
+    ::munmap(aligned + used, static_cast<size_t>(end - (aligned + used)));
+  }
+  return aligned;
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path, AccessPattern pattern) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail("Could not open file: ", path);
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    fail("Could not stat file: ", path);
+  }
+  length = static_cast<size_t>(info.st_size);
+  if (length == 0) {
+    ::close(fd);
+    return;
+  }
+
+  // A mapping that starts on a huge-page boundary can be backed by huge
+  // pages; smaller files are not worth the reservation.
+  void* address = nullptr;
+  int flags = MAP_PRIVATE;
+  if (length >= HUGE_PAGE_SIZE) {
+    address = reserveAligned(length);
+    if (address != nullptr) {
+      flags |= MAP_FIXED;
+    }
+  }
+
+  void* mapping = ::mmap(address, length, PROT_READ, flags, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    if (address != nullptr) {
+      ::munmap(address, length);
+    }
+    errno = error;
+    fail("Could not map file: ", path);
+  }
+  keys = static_cast<const int64_t*>(mapping);
+
+#ifdef MADV_HUGEPAGE
+  if (address != nullptr) {
+    huge = ::madvise(mapping, length, MADV_HUGEPAGE) == 0;
+  }
+#endif
+  advise(pattern);
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : keys(std::exchange(other.keys, nullptr)),
+      length(std::exchange(other.length, 0)),
+      huge(std::exchange(other.huge, false)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    keys = std::exchange(other.keys, nullptr);
+    length = std::exchange(other.length, 0);
+    huge = std::exchange(other.huge, false);
+  }
+  return *this;
+}
+
+void MappedFile::advise(AccessPattern pattern) {
+  if (keys == nullptr) return;
+  // Hints only steer read-ahead; a kernel that rejects one still maps the
+  // file correctly.
+  ::madvise(const_cast<int64_t*>(keys), length, adviceFor(pattern));
+}
+
+void MappedFile::willNeed(size_t offset, size_t count) {
+  if (keys == nullptr || offset >= size()) return;
+  count = std::min(count, size() - offset);
+
+  // madvise takes a page-aligned start.
+  size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t begin = offset * sizeof(int64_t) / pageSize * pageSize;
+  size_t end = (offset + count) * sizeof(int64_t);
+  char* base = reinterpret_cast<char*>(const_cast<int64_t*>(keys));
+  ::madvise(base + begin, end - begin, MADV_WILLNEED);
+}
+
+void MappedFile::unmap() {
+  if (keys != nullptr) {
+    ::munmap(const_cast<int64_t*>(keys), length);
+    keys = nullptr;
+  }
+  length = 0;
+  huge = false;
+}
@@ -0,0 +1,33 @@
+#include "utils/memory_budget.h"
+
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(size_t totalBytes)
+    : totalBytes(totalBytes), available(totalBytes) {}
+
+size_t MemoryBudget::acquire(size_t bytes) {
+  bytes = std::min(bytes, totalBytes);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  released.wait(lock, [this, bytes] { return available >= bytes; });
+  available -= bytes;
+  return bytes;
+}
+
+void MemoryBudget::release(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    available += bytes;
+  }
+  released.notify_all();
+}
+
+MemoryBudget::Reservation::Reservation(MemoryBudget& budget, size_t bytes)
+    : budget(budget), bytes(budget.acquire(bytes)) {}
+
+MemoryBudget::Reservation::~Reservation() { release(); }
+
+void MemoryBudget::Reservation::release() {
+  budget.release(bytes);
+  bytes = 0;
+}
@@ -0,0 +1,196 @@
+#include "utils/partition_writer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "utils/aligned_buffer_pool.h"
+
+PartitionWriterSet::PartitionWriterSet(IoContext& io,
+                                       const std::vector<std::string>& files,
+                                       size_t capacity, size_t spareBuffers)
+    : bufferCapacity(std::max(size_t(1), capacity)) {
+  size_t bytes = bufferCapacity * sizeof(int64_t);
+  size_t total = files.size() + std::max(size_t(1), spareBuffers);
+  try {
+    handles.reserve(files.size());
+    for (const std::string& file : files) {
+      handles.push_back(io.open(file, OpenMode::Write));
+    }
+    allBuffers.reserve(total);
+    for (size_t i = 0; i < total; i++) {
+      allBuffers.push_back(static_cast<int64_t*>(
+          AlignedBufferPool::global().acquire(bytes)));
+    }
+  } catch (...) {
+    releaseBuffers();
+    throw;
+  }
+
+  buffers.assign(allBuffers.begin(), allBuffers.begin() + files.size());
+  freeBuffers.assign(allBuffers.begin() + files.size(), allBuffers.end());
+  fills.assign(files.size(), 0);
+  written.assign(files.size(), 0);
+
+  // Every buffer the set will ever write is known up front, so all of
+  // them stay registered for the whole pass.
+  std::vector<std::pair<void*, size_t>> registered;
+  for (int64_t* buffer : allBuffers) {
+    registered.emplace_back(buffer, bytes);
+  }
+  std::vector<BlockFile*> registeredFiles;
+  for (IoContext::File& handle : handles) {
+    registeredFiles.push_back(&handle.blockFile());
+  }
+  try {
+    queue = io.createQueue();
+    queue->registerBuffers(registered);
+    queue->registerFiles(registeredFiles);
+    writer = std::thread(&PartitionWriterSet::writeLoop, this);
+  } catch (...) {
+    queue.reset();
+    releaseBuffers();
+    throw;
+  }
+}
+
+PartitionWriterSet::~PartitionWriterSet() {
+  if (writer.joinable()) {
+    stop();
+  }
+  releaseBuffers();
+}
+
+size_t PartitionWriterSet::extend(size_t partition, size_t count) {
+  size_t start = fills[partition];
+  fills[partition] += count;
+  return start;
+}
+
+void PartitionWriterSet::flush(size_t partition) {
+  handOver({partition}, true);
+}
+
+void PartitionWriterSet::flush(const std::vector<size_t>& partitions) {
+  handOver(partitions, true);
+}
+
+void PartitionWriterSet::close() {
+  if (!writer.joinable()) return;
+
+  std::vector<size_t> all(count());
+  std::iota(all.begin(), all.end(), size_t(0));
+  handOver(all, false);
+  stop();
+  handles.clear();
+  releaseBuffers();
+  throwIfFailed();
+}
+
+void PartitionWriterSet::handOver(const std::vector<size_t>& partitions,
+                                  bool replace) {
+  throwIfFailed();
+
+  bool handed = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t p : partitions) {
+      if (fills[p] == 0) continue;
+      size_t bytes = fills[p] * sizeof(int64_t);
+      pending.push_back({&handles[p].blockFile(), written[p], buffers[p],
+                         bytes});
+      written[p] += bytes;
+      buffers[p] = nullptr;
+      fills[p] = 0;
+      handed = true;
+    }
+  }
+  if (!handed) return;
+  work.notify_one();
+  if (!replace) return;
+
+  // The write-behind thread recycles every buffer it is given, even after
+  // an error, so waiting for a free one always ends.
+  std::unique_lock<std::mutex> lock(mutex);
+  for (size_t p : partitions) {
+    if (buffers[p] != nullptr) continue;
+    recycled.wait(lock, [this] { return !freeBuffers.empty(); });
+    buffers[p] = freeBuffers.back();
+    freeBuffers.pop_back();
+  }
+}
+
+void PartitionWriterSet::writeLoop() {
+  std::vector<PendingWrite> batch;
+  for (;;) {
+    bool failed;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work.wait(lock, [this] { return stopping || !pending.empty(); });
+      if (pending.empty()) return;
+      batch.swap(pending);
+      failed = error != nullptr;
+    }
+
+    // Everything handed over since the last batch goes out as one
+    // submission, one request per buffer; once a write has failed the rest
+    // are only recycled.
+    std::exception_ptr failure;
+    std::vector<size_t> tickets;
+    if (!failed) {
+      try {
+        for (const PendingWrite& write : batch) {
+          tickets.push_back(queue->write(*write.file, write.offset,
+                                         write.data, write.bytes));
+        }
+        queue->submit();
+      } catch (...) {
+        failure = std::current_exception();
+      }
+    }
+    for (size_t ticket : tickets) {
+      try {
+        queue->wait(ticket);
+      } catch (...) {
+        if (failure == nullptr) failure = std::current_exception();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (failure != nullptr && error == nullptr) error = failure;
+      for (const PendingWrite& write : batch) {
+        freeBuffers.push_back(write.data);
+      }
+    }
+    recycled.notify_all();
+    batch.clear();
+  }
+}
+
+void PartitionWriterSet::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work.notify_all();
+  writer.join();
+  queue.reset();
+}
+
+void PartitionWriterSet::releaseBuffers() {
+  size_t bytes = bufferCapacity * sizeof(int64_t);
+  for (int64_t* buffer : allBuffers) {
+    AlignedBufferPool::global().release(buffer, bytes);
+  }
+  allBuffers.clear();
+  freeBuffers.clear();
+  std::fill(buffers.begin(), buffers.end(), nullptr);
+}
+
+void PartitionWriterSet::throwIfFailed() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,234 @@
+#include "utils/quantile_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+#include "utils/sort_parameters.h"
+
+QuantileSketch::QuantileSketch(size_t k, size_t sampleGap)
+    : k(std::max(size_t(8), k)),
+      sampleGap(std::max(size_t(1), sampleGap)),
+      minKey(std::numeric_limits<int64_t>::max()),
+      maxKey(std::numeric_limits<int64_t>::min()),
+      randomState(0x9E3779B97F4A7C15ull),
+      levels(1) {
+  capacity = totalCapacity();
+}
+
+void QuantileSketch::insert(int64_t key) {
+  levels[0].push_back(key);
+  keptWeight++;
+  if (++retainedKeys > capacity) {
+    compress();
+  }
+}
+
+size_t QuantileSketch::nextGap() {
+  if (sampleGap == 1) return 1;
+
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  return 1 + randomState % (2 * sampleGap - 1);
+}
+
+void QuantileSketch::update(const int64_t* keys, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    update(keys[i]);
+  }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+  if (other.empty()) return;
+
+  if (levels.size() < other.levels.size()) {
+    levels.resize(other.levels.size());
+    capacity = totalCapacity();
+  }
+  for (size_t h = 0; h < other.levels.size(); h++) {
+    levels[h].insert(levels[h].end(), other.levels[h].begin(),
+                     other.levels[h].end());
+  }
+  n += other.n;
+  keptWeight += other.keptWeight;
+  retainedKeys += other.retainedKeys;
+  minKey = std::min(minKey, other.minKey);
+  maxKey = std::max(maxKey, other.maxKey);
+
+  while (retainedKeys > capacity) {
+    compress();
+  }
+}
+
+size_t QuantileSketch::count() const { return n; }
+
+bool QuantileSketch::empty() const { return n == 0; }
+
+size_t QuantileSketch::retained() const { return retainedKeys; }
+
+int64_t QuantileSketch::min() const { return minKey; }
+
+int64_t QuantileSketch::max() const { return maxKey; }
+
+size_t QuantileSketch::rank(int64_t key) const {
+  uint64_t below = 0;
+  for (size_t h = 0; h < levels.size(); h++) {
+    for (int64_t value : levels[h]) {
+      if (value < key) below += uint64_t(1) << h;
+    }
+  }
+  if (keptWeight == 0) return 0;
+  // Scale from kept keys to all keys added.
+  return static_cast<size_t>(static_cast<double>(below) * n / keptWeight);
+}
+
+int64_t QuantileSketch::quantile(double q) const {
+  if (empty()) {
+    throw std::runtime_error("Quantile of an empty sketch");
+  }
+  if (q <= 0.0) return minKey;
+  if (q >= 1.0) return maxKey;
+
+  std::vector<std::pair<int64_t, uint64_t>> keys = weightedKeys();
+  uint64_t target =
+      static_cast<uint64_t>(q * static_cast<double>(keptWeight));
+  uint64_t cumulative = 0;
+  for (const auto& entry : keys) {
+    cumulative += entry.second;
+    if (cumulative > target) return entry.first;
+  }
+  return maxKey;
+}
+
+std::vector<int64_t> QuantileSketch::splitters(size_t parts) const {
+  std::vector<int64_t> result;
+  if (empty() || parts < 2) return result;
+
+  std::vector<std::pair<int64_t, uint64_t>> keys = weightedKeys();
+  uint64_t total = 0;
+  for (const auto& entry : keys) {
+    total += entry.second;
+  }
+
+  size_t next = 0;
+  uint64_t cumulative = 0;
+  for (size_t i = 1; i < parts; i++) {
+    uint64_t target = total * i / parts;
+    while (next + 1 < keys.size() && cumulative + keys[next].second <= target) {
+      cumulative += keys[next].second;
+      next++;
+    }
+    result.push_back(keys[next].first);
+  }
+  return result;
+}
+
+double QuantileSketch::normalizedRankError(size_t k) {
+  // Empirical single-rank bound of KLL sketches at 99% confidence.
+  return 2.446 / std::pow(static_cast<double>(k), 0.9433);
+}
+
+QuantileSketch QuantileSketch::fromFile(const std::string& path, size_t k,
+                                        IoContext& io) {
+  IoContext::File file = io.open(path, OpenMode::Read);
+
+  QuantileSketch sketch(k);
+  std::vector<int64_t> block(MB / INT64_SIZE);
+  for (size_t offset = 0;;) {
+    size_t bytes =
+        file.read(offset, block.data(), block.size() * sizeof(int64_t));
+    size_t elementsRead = bytes / sizeof(int64_t);
+    if (elementsRead == 0) break;
+    offset += bytes;
+    sketch.update(block.data(), elementsRead);
+  }
+  return sketch;
+}
+
+void QuantileSketch::printSummary(std::ostream& out, size_t parts) const {
+  out << "count: " << n << std::endl;
+  if (empty()) return;
+
+  out << "min: " << minKey << std::endl;
+  std::vector<int64_t> keys = splitters(parts);
+  for (size_t i = 0; i < keys.size(); i++) {
+    out << "q" << (i + 1) << "/" << parts << ": " << keys[i] << std::endl;
+  }
+  out << "max: " << maxKey << std::endl;
+  out << "rank error: +/-" << normalizedRankError(k) * 100 << "%"
+      << std::endl;
+}
+
+size_t QuantileSketch::levelCapacity(size_t level) const {
+  // The top level holds k keys and each level below it two thirds as many.
+  size_t depth = levels.size() - 1 - level;
+  double capacity = k * std::pow(2.0 / 3.0, static_cast<double>(depth));
+  return std::max(size_t(8), static_cast<size_t>(std::ceil(capacity)));
+}
+
+size_t QuantileSketch::totalCapacity() const {
+  size_t total = 0;
+  for (size_t h = 0; h < levels.size(); h++) {
+    total += levelCapacity(h);
+  }
+  return total;
+}
+
+void QuantileSketch::compress() {
+  for (size_t h = 0; h < levels.size(); h++) {
+    if (levels[h].size() >= levelCapacity(h)) {
+      compact(h);
+      return;
+    }
+  }
+}
+
+void QuantileSketch::compact(size_t level) {
+  if (level + 1 == levels.size()) {
+    levels.emplace_back();
+    capacity = totalCapacity();
+  }
+
+  std::vector<int64_t>& keys = levels[level];
+  std::sort(keys.begin(), keys.end());
+
+  // An odd key stays behind so the promoted keys carry the exact weight.
+  int64_t leftover = 0;
+  bool odd = keys.size() % 2 == 1;
+  if (odd) {
+    leftover = keys.back();
+    keys.pop_back();
+  }
+
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  size_t offset = randomState & 1;
+
+  std::vector<int64_t>& above = levels[level + 1];
+  for (size_t i = offset; i < keys.size(); i += 2) {
+    above.push_back(keys[i]);
+  }
+
+  retainedKeys -= keys.size() / 2;
+  keys.clear();
+  if (odd) {
+    keys.push_back(leftover);
+  }
+}
+
+std::vector<std::pair<int64_t, uint64_t>> QuantileSketch::weightedKeys()
+    const {
+  std::vector<std::pair<int64_t, uint64_t>> keys;
+  keys.reserve(retained());
+  for (size_t h = 0; h < levels.size(); h++) {
+    for (int64_t value : levels[h]) {
+      keys.emplace_back(value, uint64_t(1) << h);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
@@ -7,28 +7,14 @@
 #include <limits>
 #include <vector>
 
-size_t calculateOptimalArity(size_t M, size_t bufferElements) {
-  const size_t maxBuffers = M / (bufferElements * sizeof(int64_t));
-
-  if (maxBuffers < 3) {
-    return 2;
-  }
-
-  size_t arity = maxBuffers - 1;
-
-  const size_t MAX_REASONABLE_ARITY = 16;
-  arity = std::min(arity, MAX_REASONABLE_ARITY);
-
-  return arity;
-}
-
 size_t calculateOptimalBufferSize(size_t M, size_t totalElements,
-                                  size_t arity) {
+                                  size_t arity, size_t buffersPerStream) {
   const size_t elementSize = sizeof(int64_t);
 
   const size_t totalBufferElements = (M * 0.9) / elementSize;
 
-  size_t elementsPerBuffer = totalBufferElements / (arity + 1);
+  size_t streamBuffers = (arity + 1) * std::max(size_t(1), buffersPerStream);
+  size_t elementsPerBuffer = totalBufferElements / streamBuffers;
 
   if (elementsPerBuffer < 1) {
     elementsPerBuffer = 1;
@@ -0,0 +1,418 @@
+#include "utils/sort_planner.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "algorithms/loser_tree.h"
+#include "algorithms/lsd_radix_sort.h"
+#include "algorithms/splitter_tree.h"
+#include "utils/file_handler.h"
+#include "utils/sort_parameters.h"
+#include "utils/timer.h"
+
+namespace {
+
+constexpr size_t CALIBRATION_FILE_BYTES = 32 * MB;
+constexpr size_t CALIBRATION_REQUEST_BYTES = MB;
+constexpr size_t CALIBRATION_RANDOM_READS = 1024;
+constexpr size_t CALIBRATION_KEYS = 1 << 20;
+
+std::string hostName() {
+  char name[256] = {};
+  if (gethostname(name, sizeof(name) - 1) != 0) return "unknown";
+  return name;
+}
+
+size_t ceilDiv(size_t a, size_t b) { return (a + b - 1) / b; }
+
+size_t treeLevels(size_t arity) {
+  size_t levels = 0;
+  while ((size_t(1) << levels) < arity) levels++;
+  return levels;
+}
+
+size_t passesToReduce(size_t count, size_t target, size_t arity) {
+  size_t passes = 0;
+  while (count > target) {
+    count = ceilDiv(count, arity);
+    passes++;
+  }
+  return passes;
+}
+
+void writeFully(int fd, const char* data, size_t bytes) {
+  while (bytes > 0) {
+    ssize_t written = ::write(fd, data, bytes);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("Error writing calibration file");
+    }
+    data += written;
+    bytes -= static_cast<size_t>(written);
+  }
+}
+
+void readFully(int fd, char* data, size_t bytes, off_t offset) {
+  while (bytes > 0) {
+    ssize_t got = ::pread(fd, data, bytes, offset);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) throw std::runtime_error("Error reading calibration file");
+    data += got;
+    bytes -= static_cast<size_t>(got);
+    offset += got;
+  }
+}
+
+void dropCache(int fd) {
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+  (void)fd;
+#endif
+}
+
+// Guards against timer resolution turning a constant into zero.
+double perUnit(double seconds, double units) {
+  return std::max(seconds, 1e-9) / units;
+}
+
+void calibrateIo(const std::string& dir, CostModel& model) {
+  std::filesystem::create_directories(dir);
+  std::string path = dir + "/cost_model_calibration.bin";
+
+  int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Could not create calibration file: " + path);
+  }
+
+  try {
+    std::vector<char> block(CALIBRATION_REQUEST_BYTES, 1);
+    Timer timer;
+
+    timer.start();
+    for (size_t i = 0; i < CALIBRATION_FILE_BYTES;
+         i += CALIBRATION_REQUEST_BYTES) {
+      writeFully(fd, block.data(), block.size());
+    }
+    ::fsync(fd);
+    timer.stop();
+    model.writeBandwidth =
+        CALIBRATION_FILE_BYTES / std::max(timer.getDuration(), 1e-9);
+
+    dropCache(fd);
+    timer.start();
+    for (size_t i = 0; i < CALIBRATION_FILE_BYTES;
+         i += CALIBRATION_REQUEST_BYTES) {
+      readFully(fd, block.data(), block.size(), static_cast<off_t>(i));
+    }
+    timer.stop();
+    model.readBandwidth =
+        CALIBRATION_FILE_BYTES / std::max(timer.getDuration(), 1e-9);
+
+    dropCache(fd);
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> blockIndex(
+        0, CALIBRATION_FILE_BYTES / BLOCK_SIZE - 1);
+    timer.start();
+    for (size_t i = 0; i < CALIBRATION_RANDOM_READS; i++) {
+      readFully(fd, block.data(), BLOCK_SIZE,
+                static_cast<off_t>(blockIndex(rng) * BLOCK_SIZE));
+    }
+    timer.stop();
+    double perRead = timer.getDuration() / CALIBRATION_RANDOM_READS;
+    model.requestLatency =
+        std::max(perRead - BLOCK_SIZE / model.readBandwidth, 1e-7);
+  } catch (...) {
+    ::close(fd);
+    std::filesystem::remove(path);
+    throw;
+  }
+
+  ::close(fd);
+  std::filesystem::remove(path);
+}
+
+void calibrateCpu(CostModel& model) {
+  std::mt19937_64 rng(7);
+  std::vector<int64_t> keys(CALIBRATION_KEYS);
+  for (auto& key : keys) key = static_cast<int64_t>(rng());
+  std::vector<int64_t> data = keys;
+  std::vector<int64_t> scratch(keys.size());
+  Timer timer;
+
+  timer.start();
+  sortKeys(data.data(), data.size(), scratch.data());
+  timer.stop();
+  model.sortCost = perUnit(timer.getDuration(), keys.size());
+
+  const size_t mergeWays = 16;
+  size_t runLength = keys.size() / mergeWays;
+  std::vector<std::pair<const int64_t*, const int64_t*>> runs;
+  data = keys;
+  for (size_t i = 0; i < mergeWays; i++) {
+    std::sort(data.begin() + i * runLength, data.begin() + (i + 1) * runLength);
+    runs.push_back({data.data() + i * runLength,
+                    data.data() + (i + 1) * runLength});
+  }
+  timer.start();
+  multiwayMerge(runs, scratch.data());
+  timer.stop();
+  model.mergeCost = perUnit(timer.getDuration(),
+                            double(keys.size()) * treeLevels(mergeWays));
+
+  const size_t parts = 64;
+  std::vector<int64_t> pivots(keys.begin(), keys.begin() + parts - 1);
+  std::sort(pivots.begin(), pivots.end());
+  SplitterTree<int64_t> tree(pivots);
+  std::vector<uint32_t> buckets(keys.size());
+  // Classified in chunks, as the distribution loop does.
+  const size_t chunk = 256;
+  timer.start();
+  for (size_t i = 0; i < keys.size(); i += chunk) {
+    size_t count = std::min(chunk, keys.size() - i);
+    tree.classify(keys.data() + i, count, buckets.data() + i);
+  }
+  timer.stop();
+  model.classifyCost = perUnit(timer.getDuration(),
+                               double(keys.size()) * treeLevels(parts));
+
+  std::vector<std::vector<int64_t>> out(parts);
+  for (auto& bucket : out) bucket.reserve(keys.size() / parts * 2);
+  timer.start();
+  for (size_t i = 0; i < keys.size(); i++) {
+    out[buckets[i]].push_back(keys[i]);
+  }
+  timer.stop();
+  model.scatterCost = perUnit(timer.getDuration(), keys.size());
+}
+
+double ioSeconds(const CostModel& model, double bytesRead,
+                 double bytesWritten, double requests) {
+  return bytesRead / model.readBandwidth +
+         bytesWritten / model.writeBandwidth +
+         requests * model.requestLatency;
+}
+
+}  // namespace
+
+CostModel CostModel::defaults() {
+  CostModel model;
+  model.readBandwidth = 500.0 * MB;
+  model.writeBandwidth = 400.0 * MB;
+  model.requestLatency = 100e-6;
+  model.sortCost = 10e-9;
+  model.mergeCost = 3e-9;
+  model.classifyCost = 1.5e-9;
+  model.scatterCost = 2e-9;
+  return model;
+}
+
+CostModel CostModel::calibrate(const std::string& dir) {
+  CostModel model = defaults();
+  calibrateIo(dir, model);
+  calibrateCpu(model);
+  return model;
+}
+
+bool CostModel::load(const std::string& path, CostModel& model) {
+  std::ifstream in(path);
+  if (!in.is_open()) return false;
+
+  std::string host;
+  CostModel loaded;
+  std::string key;
+  if (!(in >> key >> host) || key != "host" || host != hostName()) {
+    return false;
+  }
+
+  const std::pair<const char*, double*> fields[] = {
+      {"read_bandwidth", &loaded.readBandwidth},
+      {"write_bandwidth", &loaded.writeBandwidth},
+      {"request_latency", &loaded.requestLatency},
+      {"sort_cost", &loaded.sortCost},
+      {"merge_cost", &loaded.mergeCost},
+      {"classify_cost", &loaded.classifyCost},
+      {"scatter_cost", &loaded.scatterCost},
+  };
+  for (const auto& field : fields) {
+    if (!(in >> key >> *field.second) || key != field.first ||
+        !(*field.second > 0)) {
+      return false;
+    }
+  }
+
+  model = loaded;
+  return true;
+}
+
+void CostModel::save(const std::string& path) const {
+  std::filesystem::path parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty()) std::filesystem::create_directories(parent);
+
+  std::ofstream out(path, std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Could not write cost model: " + path);
+  }
+  out.precision(10);
+  out << "host " << hostName() << "\n"
+      << "read_bandwidth " << readBandwidth << "\n"
+      << "write_bandwidth " << writeBandwidth << "\n"
+      << "request_latency " << requestLatency << "\n"
+      << "sort_cost " << sortCost << "\n"
+      << "merge_cost " << mergeCost << "\n"
+      << "classify_cost " << classifyCost << "\n"
+      << "scatter_cost " << scatterCost << "\n";
+}
+
+CostModel CostModel::forMachine(const std::string& cachePath) {
+  CostModel model;
+  if (load(cachePath, model)) return model;
+
+  std::filesystem::path parent = std::filesystem::path(cachePath).parent_path();
+  std::string dir = parent.empty() ? "." : parent.string();
+
+  std::cout << "Calibrating cost model in " << dir << "..." << std::endl;
+  try {
+    model = calibrate(dir);
+    model.save(cachePath);
+  } catch (const std::exception& e) {
+    std::cerr << "Calibration failed (" << e.what()
+              << "), using default cost model" << std::endl;
+    model = defaults();
+  }
+  std::cout << model << std::endl;
+  return model;
+}
+
+SortPlan evaluatePlan(SortEngine engine, size_t N, size_t M, size_t arity,
+                      const CostModel& model, size_t threads) {
+  arity = std::max(arity, size_t(2));
+  const double bytes = double(N) * sizeof(int64_t);
+  SortPlan plan{arity, 0, 0, 0.0, 0.0};
+
+  if (engine == SortEngine::MergeSort) {
+    size_t runs = std::max(ceilDiv(N, mergeRunElements(M)), size_t(1));
+    size_t mergePasses = passesToReduce(runs, 1, arity);
+
+    plan.bufferElements = calculateOptimalBufferSize(M, N, arity, 2);
+    plan.passes = 1 + mergePasses;
+    plan.ioSeconds = ioSeconds(model, bytes, bytes, 2.0 * runs);
+    plan.cpuSeconds = N * model.sortCost;
+
+    double requests = 2.0 * ceilDiv(N, plan.bufferElements);
+    plan.ioSeconds +=
+        mergePasses * ioSeconds(model, bytes, bytes, requests);
+    plan.cpuSeconds +=
+        mergePasses * double(N) * model.mergeCost * treeLevels(arity);
+    return plan;
+  }
+
+  if (engine == SortEngine::RadixSort) {
+    size_t bits = 0;
+    while (bits < 16 && (size_t(2) << bits) <= arity) bits++;
+    plan.arity = size_t(1) << std::max(bits, size_t(1));
+    threads = 1;
+  }
+
+  size_t leafElements = std::max(M / sizeof(int64_t), size_t(1));
+  plan.bufferElements = distributionBufferElements(M, plan.arity, threads);
+
+  if (N <= leafElements) {
+    plan.cpuSeconds = N * model.sortCost;
+    return plan;
+  }
+
+  size_t splitPasses = passesToReduce(N, leafElements, plan.arity);
+  double perElement = model.scatterCost;
+  if (engine == SortEngine::QuickSort) {
+    perElement += model.classifyCost * treeLevels(plan.arity);
+  }
+
+  double requests = 2.0 * ceilDiv(N, plan.bufferElements);
+  plan.passes = splitPasses + 1;
+  plan.ioSeconds = splitPasses * ioSeconds(model, bytes, bytes, requests) +
+                   ioSeconds(model, bytes, bytes,
+                             2.0 * ceilDiv(N, leafElements));
+  plan.cpuSeconds = splitPasses * double(N) * perElement + N * model.sortCost;
+  return plan;
+}
+
+SortPlan planSort(SortEngine engine, size_t N, size_t M,
+                  const CostModel& model, size_t threads) {
+  // Merge streams are double-buffered in 90% of M; distribution keeps
+  // distributionBuffers(a, threads) buffers in 80% of M.
+  const size_t streamBytes =
+      engine == SortEngine::MergeSort ? 2 * BLOCK_SIZE : BLOCK_SIZE;
+  const size_t usable =
+      engine == SortEngine::MergeSort ? size_t(M * 0.9) : size_t(M * 0.8);
+  const size_t extra =
+      engine == SortEngine::MergeSort
+          ? 1
+          : distributionBuffers(0, engine == SortEngine::QuickSort ? threads
+                                                                   : 1);
+  size_t maxArity = usable / streamBytes;
+  maxArity = std::clamp(maxArity > extra ? maxArity - extra : 0, size_t(2),
+                        MAX_PLAN_ARITY);
+
+  SortPlan best = evaluatePlan(engine, N, M, 2, model, threads);
+  for (size_t a = 3; a <= maxArity; a++) {
+    if (engine == SortEngine::RadixSort && (a & (a - 1)) != 0) continue;
+    SortPlan plan = evaluatePlan(engine, N, M, a, model, threads);
+    if (plan.seconds() < best.seconds()) best = plan;
+  }
+  return best;
+}
+
+std::ostream& operator<<(std::ostream& out, const CostModel& model) {
+  return out << "read " << model.readBandwidth / MB << " MB/s, write "
+             << model.writeBandwidth / MB << " MB/s, latency "
+             << model.requestLatency * 1e6 << " us/request, sort "
+             << model.sortCost * 1e9 << " ns, merge " << model.mergeCost * 1e9
+             << " ns/level, classify " << model.classifyCost * 1e9
+             << " ns/level, scatter " << model.scatterCost * 1e9
+             << " ns per element";
+}
+
+std::ostream& operator<<(std::ostream& out, const SortPlan& plan) {
+  return out << "arity=" << plan.arity
+             << ", buffer=" << plan.bufferElements
+             << " elements, passes=" << plan.passes
+             << ", predicted " << plan.seconds() << " s (I/O "
+             << plan.ioSeconds << " s, CPU " << plan.cpuSeconds << " s)";
+}
+
+std::ostream& operator<<(std::ostream& out,
+                         const SortExplanation& explanation) {
+  return out << explanation.runs << " runs/partitions, "
+             << explanation.passes << " passes, " << explanation.diskReads
+             << " disk reads, " << explanation.diskWrites
+             << " disk writes, temp space "
+             << double(explanation.peakTempBytes) / MB << " MB, buffers "
+             << double(explanation.peakBufferBytes) / MB << " MB";
+}
+
+void compareWithCounters(std::ostream& out,
+                         const SortExplanation& predicted) {
+  auto line = [&out](const char* name, size_t expected, size_t measured) {
+    out << "  " << name << ": predicted " << expected << ", measured "
+        << measured;
+    if (measured > 0) {
+      double error = (double(expected) - double(measured)) / measured;
+      out << " (" << (error >= 0 ? "+" : "") << error * 100 << "%)";
+    }
+    out << "\n";
+  };
+  line("Disk reads", predicted.diskReads, getDiskReadCount());
+  line("Disk writes", predicted.diskWrites, getDiskWriteCount());
+}
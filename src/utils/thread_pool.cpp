@@ -0,0 +1,163 @@
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  threadCount = std::max(size_t(1), threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+  std::packaged_task<void()> packaged(std::move(task));
+  std::future<void> result = packaged.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push(std::move(packaged));
+  }
+  condition.notify_one();
+
+  return result;
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::packaged_task<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+
+    task();
+  }
+}
+
+TaskGroup::TaskGroup(ThreadPool* pool) : pool(pool) {}
+
+TaskGroup::~TaskGroup() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this] { return pending == 0; });
+}
+
+void TaskGroup::run(std::function<void()> task) {
+  if (pool == nullptr) {
+    task();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending++;
+  }
+
+  pool->submit([this, task = std::move(task)] {
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    finish(error);
+  });
+}
+
+void TaskGroup::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this] { return pending == 0; });
+  if (firstError) {
+    std::exception_ptr error = firstError;
+    firstError = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+ThreadPool* TaskGroup::getPool() const { return pool; }
+
+void TaskGroup::finish(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (error && !firstError) {
+    firstError = error;
+  }
+  if (--pending == 0) {
+    idle.notify_all();
+  }
+}
+
+void parallelFor(ThreadPool* pool, size_t count,
+                 const std::function<void(size_t)>& body) {
+  if (pool == nullptr || count <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      body(i);
+    }
+    return;
+  }
+
+  // Helpers may start after the loop is over, so they share the state
+  // through a pointer that outlives this call and touch body only after
+  // claiming an index.
+  struct State {
+    std::atomic<size_t> next{0};
+    size_t finished = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto state = std::make_shared<State>();
+  const std::function<void(size_t)>* work = &body;
+
+  auto drain = [state, work, count] {
+    size_t processed = 0;
+    std::exception_ptr error;
+    for (size_t i; (i = state->next++) < count;) {
+      try {
+        (*work)(i);
+      } catch (...) {
+        if (!error) error = std::current_exception();
+      }
+      processed++;
+    }
+
+    if (processed > 0) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (error && !state->error) state->error = error;
+      state->finished += processed;
+      if (state->finished == count) state->done.notify_all();
+    }
+  };
+
+  size_t helpers = std::min(pool->size(), count - 1);
+  for (size_t i = 0; i < helpers; i++) {
+    pool->submit(drain);
+  }
+  drain();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&state, count] { return state->finished == count; });
+  if (state->error) {
+    std::rethrow_exception(state->error);
+  }
+}
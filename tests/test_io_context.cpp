@@ -0,0 +1,806 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "algorithms/mergesort.h"
+#include "algorithms/quicksort.h"
+#include "algorithms/radixsort.h"
+#include "utils/aligned_buffer_pool.h"
+#include "utils/file_handler.h"
+#include "utils/io_context.h"
+#include "utils/io_queue.h"
+#include "utils/mapped_file.h"
+#include "utils/partition_writer.h"
+#include "utils/test_generator.h"
+#include "utils/timer.h"
+
+/**
+ * @brief Posix backend that counts the files it opens.
+ */
+class CountingDevice : public PosixBlockDevice {
+ public:
+  std::unique_ptr<BlockFile> open(const std::string& path,
+                                  OpenMode mode) override {
+    opens++;
+    return PosixBlockDevice::open(path, mode);
+  }
+  std::string name() const override { return "counting"; }
+
+  std::atomic<size_t> opens{0};
+};
+
+/**
+ * @brief Posix backend whose reads fail once a number of them succeeded.
+ */
+class FailingDevice : public PosixBlockDevice {
+ public:
+  explicit FailingDevice(size_t reads) : remaining(reads) {}
+
+  std::unique_ptr<BlockFile> open(const std::string& path,
+                                  OpenMode mode) override {
+    return std::make_unique<File>(PosixBlockDevice::open(path, mode),
+                                  remaining);
+  }
+  std::string name() const override { return "failing"; }
+
+ private:
+  class File : public BlockFile {
+   public:
+    File(std::unique_ptr<BlockFile> file, std::atomic<size_t>& remaining)
+        : file(std::move(file)), remaining(remaining) {}
+
+    size_t read(size_t offset, void* dest, size_t bytes) override {
+      size_t left = remaining.load();
+      while (true) {
+        if (left == 0) throw std::runtime_error("Injected read failure");
+        if (remaining.compare_exchange_weak(left, left - 1)) break;
+      }
+      return file->read(offset, dest, bytes);
+    }
+    void write(size_t offset, const void* src, size_t bytes) override {
+      file->write(offset, src, bytes);
+    }
+    void append(const void* src, size_t bytes) override {
+      file->append(src, bytes);
+    }
+    size_t size() const override { return file->size(); }
+
+   private:
+    std::unique_ptr<BlockFile> file;
+    std::atomic<size_t>& remaining;
+  };
+
+  std::atomic<size_t> remaining;
+};
+
+/**
+ * @brief Posix backend whose reads return at most half the requested
+ * elements, as if the file ended early.
+ */
+class ShortReadDevice : public PosixBlockDevice {
+ public:
+  std::unique_ptr<BlockFile> open(const std::string& path,
+                                  OpenMode mode) override {
+    return std::make_unique<File>(PosixBlockDevice::open(path, mode));
+  }
+  std::string name() const override { return "short-read"; }
+
+ private:
+  class File : public BlockFile {
+   public:
+    explicit File(std::unique_ptr<BlockFile> file) : file(std::move(file)) {}
+
+    size_t read(size_t offset, void* dest, size_t bytes) override {
+      size_t half = bytes / 2 / sizeof(int64_t) * sizeof(int64_t);
+      return file->read(offset, dest, std::max(half, sizeof(int64_t)));
+    }
+    void write(size_t offset, const void* src, size_t bytes) override {
+      file->write(offset, src, bytes);
+    }
+    void append(const void* src, size_t bytes) override {
+      file->append(src, bytes);
+    }
+    size_t size() const override { return file->size(); }
+
+   private:
+    std::unique_ptr<BlockFile> file;
+  };
+};
+
+bool sameStats(const IoStats& a, const IoStats& b) {
+  return a.readRequests == b.readRequests &&
+         a.writeRequests == b.writeRequests && a.bytesRead == b.bytesRead &&
+         a.bytesWritten == b.bytesWritten && a.blocksRead == b.blocksRead &&
+         a.blocksWritten == b.blocksWritten;
+}
+
+void testAccounting() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/file.bin";
+
+  IoContext io;
+  resetDiskCounters();
+
+  std::vector<char> data(10000, 'x');
+  {
+    IoContext::File file = io.open(path, OpenMode::Write);
+    // [100, 10100) touches blocks 0, 1 and 2.
+    file.write(100, data.data(), data.size());
+    assert(file.size() == 10100);
+  }
+  {
+    IoContext::File file = io.open(path, OpenMode::Append);
+    file.append(data.data(), 1);
+  }
+  {
+    IoContext::File file = io.open(path, OpenMode::Read);
+    char byte;
+    assert(file.read(4095, &byte, 1) == 1);
+    // Reads past the end move no data and are not requests.
+    assert(file.read(20000, &byte, 1) == 0);
+    std::vector<char> all(20000);
+    assert(file.read(0, all.data(), all.size()) == 10101);
+  }
+
+  IoStats stats = io.stats();
+  assert(stats.writeRequests == 2 && stats.readRequests == 2);
+  assert(stats.bytesWritten == 10001 && stats.bytesRead == 10102);
+  assert(stats.blocksWritten == 3 + 1 && stats.blocksRead == 1 + 3);
+  assert(getDiskWriteCount() == 2 && getDiskReadCount() == 2);
+
+  // The file handler helpers are one request each.
+  std::vector<int64_t> values = {3, 1, 2};
+  writeInt64DataToFile(values, path, io);
+  assert(readInt64FromFile(path, io) == values);
+  appendInt64DataToFile(values, path, io);
+  assert(readBlockFromFile(path, 24, 24, io) == values);
+  assert(io.stats().writeRequests == 4 && io.stats().readRequests == 4);
+
+  io.reset();
+  assert(sameStats(io.stats(), IoStats{0, 0, 0, 0, 0, 0}));
+
+  std::filesystem::remove_all(dir);
+}
+
+void testConcurrentAccounting() {
+  IoContext io;
+  const size_t threads = 4;
+  const size_t requests = 20000;
+
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&io] {
+      for (size_t i = 0; i < requests; i++) {
+        io.recordRead(i * IO_BLOCK_SIZE, IO_BLOCK_SIZE);
+        io.recordWrite(0, 1);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  IoStats stats = io.stats();
+  assert(stats.readRequests == threads * requests);
+  assert(stats.bytesRead == threads * requests * IO_BLOCK_SIZE);
+  assert(stats.blocksRead == threads * requests);
+  assert(stats.writeRequests == threads * requests);
+  assert(stats.blocksWritten == threads * requests);
+}
+
+void testQueue(IoQueueKind kind) {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/queue.bin";
+
+  IoContext io;
+  io.setQueue(4, kind);
+  std::unique_ptr<IoQueue> queue = io.createQueue();
+  assert(queue->depth() == 4);
+  if (kind == IoQueueKind::ThreadPool) {
+    assert(queue->name() == "threads");
+  }
+  std::cout << "Queue backend: " << queue->name() << std::endl;
+
+  // More requests than the depth are queued before any is waited for.
+  const size_t chunks = 16;
+  const size_t chunk = 8192;
+  std::vector<char> out(chunks * chunk);
+  for (size_t i = 0; i < out.size(); i++) {
+    out[i] = static_cast<char>(i * 31 + i / chunk);
+  }
+  IoContext::File file = io.open(path, OpenMode::Write);
+  queue->registerFiles({&file.blockFile()});
+  std::vector<size_t> tickets;
+  for (size_t i = 0; i < chunks; i++) {
+    tickets.push_back(queue->write(file.blockFile(), i * chunk,
+                                   out.data() + i * chunk, chunk));
+  }
+  queue->submit();
+  for (size_t ticket : tickets) {
+    assert(queue->wait(ticket) == chunk);
+  }
+  assert(file.size() == out.size());
+
+  // Reads into registered buffers, waited for out of order, and a read
+  // that crosses the end of the file.
+  std::vector<char> in(out.size() + chunk);
+  queue->registerBuffers({{in.data(), in.size()}});
+  tickets.clear();
+  auto offsetOf = [&](size_t i) {
+    return i < chunks ? i * chunk - i % 2 : out.size() - 100;
+  };
+  for (size_t i = 0; i <= chunks; i++) {
+    tickets.push_back(queue->read(file.blockFile(), offsetOf(i),
+                                  in.data() + i * chunk, chunk));
+  }
+  queue->submit();
+  for (size_t i = tickets.size(); i-- > 0;) {
+    size_t length = i < chunks ? chunk : 100;
+    assert(queue->wait(tickets[i]) == length);
+    assert(std::equal(out.begin() + offsetOf(i),
+                      out.begin() + offsetOf(i) + length,
+                      in.begin() + i * chunk));
+  }
+
+  IoStats stats = io.stats();
+  assert(stats.writeRequests == chunks && stats.readRequests == chunks + 1);
+  assert(stats.bytesWritten == out.size());
+  assert(stats.bytesRead == out.size() + 100);
+
+  queue.reset();
+  std::filesystem::remove_all(dir);
+}
+
+void testAlignedBufferPool() {
+  AlignedBufferPool pool(1 << 20);
+  void* first = pool.acquire(100);
+  assert(reinterpret_cast<uintptr_t>(first) % BUFFER_ALIGNMENT == 0);
+  pool.release(first, 100);
+  assert(pool.idleBytes() == BUFFER_ALIGNMENT);
+
+  // A request of the same rounded size reuses the released buffer.
+  void* second = pool.acquire(BUFFER_ALIGNMENT);
+  assert(second == first && pool.allocations() == 1);
+  pool.release(second, BUFFER_ALIGNMENT);
+
+  // Idle buffers count against the capacity together with live ones: an
+  // allocation beyond it frees them, and buffers released beyond it are
+  // freed.
+  void* large = pool.acquire(2 << 20);
+  assert(pool.idleBytes() == 0 && pool.liveBytes() == 2 << 20);
+  pool.release(large, 2 << 20);
+  assert(pool.idleBytes() == 0 && pool.liveBytes() == 0);
+  assert(pool.peakBytes() == 2 << 20);
+
+  void* held = pool.acquire(768 << 10);
+  void* extra = pool.acquire(512 << 10);
+  pool.release(extra, 512 << 10);
+  assert(pool.idleBytes() == 0);
+  pool.release(held, 768 << 10);
+  assert(pool.idleBytes() == 768 << 10);
+
+  // Lowering the capacity frees the idle buffers beyond it.
+  assert(pool.setCapacity(512 << 10) == 1 << 20);
+  assert(pool.idleBytes() == 0);
+  pool.resetPeak();
+  assert(pool.peakBytes() == 0);
+
+  AlignedVector<int64_t> values(1000, 7);
+  assert(reinterpret_cast<uintptr_t>(values.data()) % BUFFER_ALIGNMENT == 0);
+}
+
+template <typename Sorter>
+void checkPoolWithinBudget(Sorter& sorter, const std::vector<int64_t>& data,
+                           const std::vector<int64_t>& expected, size_t M) {
+  AlignedBufferPool& pool = AlignedBufferPool::global();
+  assert(pool.liveBytes() == 0);
+  pool.trim();
+  pool.resetPeak();
+
+  std::vector<int64_t> output(data.size());
+  sorter.sortView(data.data(), data.size(), output.data(), M, 8);
+  assert(output == expected);
+  assert(pool.peakBytes() <= M);
+  assert(pool.idleBytes() == 0 && pool.liveBytes() == 0);
+}
+
+void testPoolWithinBudget() {
+  // Two levels of partitioning: the buffers the first pass leaves in the
+  // pool must give way to the in-memory sorts of its children.
+  std::vector<int64_t> data = generateRandomInt64Data(400000);
+  std::vector<int64_t> expected = data;
+  std::sort(expected.begin(), expected.end());
+  const size_t M = 256 * 1024;
+
+  QuickSort quickSort;
+  checkPoolWithinBudget(quickSort, data, expected, M);
+  quickSort.setThreadCount(4);
+  checkPoolWithinBudget(quickSort, data, expected, M);
+
+  RadixSort radixSort;
+  checkPoolWithinBudget(radixSort, data, expected, M);
+}
+
+void testDirectDevice() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/direct.bin";
+
+  IoContext io(std::make_shared<DirectBlockDevice>());
+  assert(io.device().alignment() == BUFFER_ALIGNMENT);
+  assert(io.alignedCount(1000, sizeof(int64_t)) == 512);
+  assert(io.alignedCount(100, sizeof(int64_t)) == 100);
+
+  // Random writes of every alignment, checked against a model of the file.
+  std::vector<char> model;
+  std::mt19937 rng(7);
+  {
+    IoContext::File file = io.open(path, OpenMode::Write);
+    AlignedVector<char> data(3 * 256 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i] = static_cast<char>(rng());
+    }
+    for (int step = 0; step < 200; step++) {
+      bool aligned = step % 4 == 0;
+      size_t offset = rng() % (model.size() + 9000);
+      size_t bytes = 1 + rng() % (step % 10 == 0 ? data.size() - 1 : 20000);
+      size_t from = rng() % (data.size() - bytes + 1);
+      if (aligned) {
+        offset -= offset % BUFFER_ALIGNMENT;
+        bytes = std::max(BUFFER_ALIGNMENT, bytes - bytes % BUFFER_ALIGNMENT);
+        from = 0;
+      }
+      if (step % 3 == 0) {
+        offset = model.size();
+        file.append(data.data() + from, bytes);
+      } else {
+        file.write(offset, data.data() + from, bytes);
+      }
+      model.resize(std::max(model.size(), offset + bytes), 0);
+      std::copy(data.begin() + from, data.begin() + from + bytes,
+                model.begin() + offset);
+      assert(file.size() == model.size());
+    }
+  }
+  assert(std::filesystem::file_size(path) == model.size());
+  {
+    IoContext::File file = io.open(path, OpenMode::Read);
+    std::vector<char> all(model.size() + 5000);
+    assert(file.read(0, all.data(), all.size()) == model.size());
+    assert(std::equal(model.begin(), model.end(), all.begin()));
+    for (int step = 0; step < 100; step++) {
+      size_t offset = rng() % model.size();
+      size_t bytes = 1 + rng() % 70000;
+      size_t expected = std::min(bytes, model.size() - offset);
+      assert(file.read(offset, all.data() + 1, bytes) == expected);
+      assert(std::equal(model.begin() + offset,
+                        model.begin() + offset + expected, all.begin() + 1));
+    }
+  }
+
+  // Concurrent writers of neighbouring unaligned ranges share blocks.
+  {
+    IoContext::File file = io.open(path, OpenMode::Write);
+    const size_t threads = 4;
+    const size_t pieces = 50;
+    const size_t piece = 1000;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+      workers.emplace_back([&file, t] {
+        std::vector<char> data(piece, static_cast<char>('a' + t));
+        for (size_t i = t; i < pieces * threads; i += threads) {
+          file.write(i * piece, data.data(), piece);
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    std::vector<char> all(pieces * threads * piece);
+    assert(file.size() == all.size());
+    assert(file.read(0, all.data(), all.size()) == all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+      assert(all[i] == static_cast<char>('a' + i / piece % threads));
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+void testPartitionWriterSet() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+
+  auto device = std::make_shared<CountingDevice>();
+  IoContext io(device);
+  std::vector<std::string> files;
+  for (size_t p = 0; p < 8; p++) {
+    files.push_back(dir + "/partition_" + std::to_string(p) + ".bin");
+  }
+
+  // One spare buffer makes the filling thread wait for the writer, and
+  // batched flushes of partial buffers mix with pushes.
+  std::vector<std::vector<int64_t>> expected(files.size());
+  size_t flushes = 0;
+  {
+    PartitionWriterSet writers(io, files, 100, 1);
+    std::mt19937_64 rng(11);
+    for (size_t i = 0; i < 20000; i++) {
+      int64_t key = static_cast<int64_t>(rng());
+      size_t p = static_cast<size_t>(key) % files.size();
+      expected[p].push_back(key);
+      writers.push(p, key);
+      if (writers.size(p) == 0) flushes++;
+
+      if (i % 1000 == 999) {
+        std::vector<size_t> all;
+        for (size_t q = 0; q < files.size(); q++) {
+          if (writers.size(q) > 0) flushes++;
+          all.push_back(q);
+        }
+        writers.flush(all);
+      }
+    }
+    size_t start = writers.extend(3, 5);
+    std::fill(writers.buffer(3) + start, writers.buffer(3) + start + 5, 42);
+    expected[3].insert(expected[3].end(), 5, 42);
+    for (size_t q = 0; q < files.size(); q++) {
+      if (writers.size(q) > 0) flushes++;
+    }
+    writers.close();
+    writers.close();
+  }
+
+  // Each file is opened once and each flush is one write request.
+  assert(device->opens == files.size());
+  assert(io.stats().writeRequests == flushes);
+  for (size_t p = 0; p < files.size(); p++) {
+    std::vector<int64_t> actual = readInt64DataFromFile(files[p]);
+    assert(actual == expected[p]);
+    std::filesystem::remove(files[p]);
+  }
+
+  bool threw = false;
+  try {
+    PartitionWriterSet missing(io, {dir + "/missing/partition.bin"}, 100);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void testMappedFile() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/mapped.bin";
+
+  // Large enough to be placed on a huge-page boundary.
+  std::vector<int64_t> data = generateRandomInt64Data(300000);
+  writeInt64DataToFile(data, path);
+  {
+    MappedFile mapped(path);
+    assert(mapped.size() == data.size());
+    assert(mapped.bytes() == data.size() * sizeof(int64_t));
+    assert(std::equal(data.begin(), data.end(), mapped.data()));
+    assert(reinterpret_cast<uintptr_t>(mapped.data()) % (2 << 20) == 0);
+    std::cout << "Mapped with huge pages: "
+              << (mapped.hugePages() ? "yes" : "no") << std::endl;
+
+    mapped.advise(AccessPattern::Random);
+    mapped.willNeed(1001, 5000);
+    mapped.willNeed(data.size() - 1, 100);
+
+    MappedFile moved = std::move(mapped);
+    assert(mapped.data() == nullptr && mapped.size() == 0);
+    assert(moved.data()[12345] == data[12345]);
+  }
+
+  writeInt64DataToFile({}, path);
+  MappedFile empty(path);
+  assert(empty.data() == nullptr && empty.size() == 0);
+
+  bool threw = false;
+  try {
+    MappedFile missing(dir + "/missing.bin");
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  std::filesystem::remove_all(dir);
+}
+
+template <typename Sorter, typename SortArray>
+void checkView(Sorter& sorter, const SortArray& sortArray,
+               const MappedFile& input, const std::vector<int64_t>& expected,
+               size_t M) {
+  std::vector<int64_t> output(input.size());
+  sorter.sortView(input.data(), input.size(), output.data(), M, 8);
+  assert(output == expected);
+  IoStats view = sorter.ioStats();
+
+  // A finished sort keeps no idle aligned buffers beyond its budget.
+  assert(AlignedBufferPool::global().idleBytes() == 0);
+
+  // Like the in-memory array it replaces, the mapping is not read through
+  // the I/O layer, so both entry points issue the same requests.
+  std::vector<int64_t> arr(input.data(), input.data() + input.size());
+  sortArray(arr, M, 8);
+  assert(arr == expected);
+  assert(sameStats(view, sorter.ioStats()));
+}
+
+void testSortView() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string path = dir + "/view.bin";
+
+  std::vector<int64_t> data = generateRandomInt64Data(60000);
+  writeInt64DataToFile(data, path);
+  std::vector<int64_t> expected = data;
+  std::sort(expected.begin(), expected.end());
+  MappedFile input(path);
+  std::vector<int64_t> output(input.size());
+  const size_t M = 64 * 1024;
+
+  MergeSort mergeSort;
+  mergeSort.setTempDirectory(dir + "/merge_temp");
+  checkView(
+      mergeSort,
+      [&](std::vector<int64_t>& arr, size_t limit, size_t a) {
+        mergeSort.externalSort(arr, limit, a);
+      },
+      input, expected, M);
+  QuickSort quickSort;
+  checkView(
+      quickSort,
+      [&](std::vector<int64_t>& arr, size_t limit, size_t a) {
+        quickSort.sort(arr, limit, a);
+      },
+      input, expected, M);
+  RadixSort radixSort;
+  checkView(
+      radixSort,
+      [&](std::vector<int64_t>& arr, size_t limit, size_t a) {
+        radixSort.sort(arr, limit, a);
+      },
+      input, expected, M);
+
+  // MergeSort runs are exactly as predicted.
+  SortExplanation predicted = mergeSort.explain(input.size(), M, 8);
+  mergeSort.sortView(input.data(), input.size(), output.data(), M, 8);
+  assert(mergeSort.ioStats().readRequests == predicted.diskReads);
+  assert(mergeSort.ioStats().writeRequests == predicted.diskWrites);
+
+  // A dataset that fits in M is sorted straight into the output.
+  quickSort.sortView(input.data(), input.size(), output.data(),
+                     input.bytes(), 8);
+  assert(output == expected);
+
+  std::filesystem::remove_all(dir);
+}
+
+template <typename Sorter>
+void checkEngine(Sorter& sorter, const std::string& inputFile,
+                 const std::string& outputFile,
+                 const std::vector<int64_t>& expected, size_t M) {
+  auto device = std::make_shared<CountingDevice>();
+  sorter.setBlockDevice(device);
+  sorter.sortFile(inputFile, outputFile, M, 8);
+
+  // Every transfer of the sort went through the chosen backend and is
+  // reflected in the legacy counters.
+  IoStats stats = sorter.ioStats();
+  size_t bytes = expected.size() * sizeof(int64_t);
+  assert(device->opens > 2);
+  assert(stats.bytesRead >= bytes && stats.bytesWritten >= 2 * bytes);
+  assert(stats.blocksRead >= bytes / IO_BLOCK_SIZE);
+  assert(stats.readRequests == getDiskReadCount());
+  assert(stats.writeRequests == getDiskWriteCount());
+
+  assert(readInt64FromFile(outputFile) == expected);
+}
+
+void testEnginesUseDevice() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string inputFile = dir + "/input.bin";
+  const std::string outputFile = dir + "/output.bin";
+
+  std::vector<int64_t> data = generateRandomInt64Data(60000);
+  writeInt64DataToFile(data, inputFile);
+  std::vector<int64_t> expected = data;
+  std::sort(expected.begin(), expected.end());
+  const size_t M = 64 * 1024;
+
+  MergeSort mergeSort;
+  mergeSort.setTempDirectory(dir + "/merge_temp");
+  checkEngine(mergeSort, inputFile, outputFile, expected, M);
+
+  QuickSort quickSort;
+  checkEngine(quickSort, inputFile, outputFile, expected, M);
+
+  RadixSort radixSort;
+  checkEngine(radixSort, inputFile, outputFile, expected, M);
+
+  // Direct I/O bypasses the page cache without changing the output.
+  auto direct = std::make_shared<DirectBlockDevice>();
+  mergeSort.setBlockDevice(direct);
+  mergeSort.sortFile(inputFile, outputFile, M, 8);
+  assert(readInt64FromFile(outputFile) == expected);
+  mergeSort.setRunGeneration(RunGeneration::ReplacementSelection);
+  mergeSort.sortFile(inputFile, outputFile, M, 8);
+  assert(readInt64FromFile(outputFile) == expected);
+  mergeSort.setRunGeneration(RunGeneration::FixedSize);
+  quickSort.setBlockDevice(direct);
+  quickSort.sortFile(inputFile, outputFile, M, 8);
+  assert(readInt64FromFile(outputFile) == expected);
+  radixSort.setBlockDevice(direct);
+  radixSort.sortFile(inputFile, outputFile, M, 8);
+  assert(readInt64FromFile(outputFile) == expected);
+
+  // Every queue backend yields the same output.
+  for (IoQueueKind kind : {IoQueueKind::Uring, IoQueueKind::ThreadPool}) {
+    mergeSort.setIoQueue(3, kind);
+    checkEngine(mergeSort, inputFile, outputFile, expected, M);
+    quickSort.setIoQueue(3, kind);
+    checkEngine(quickSort, inputFile, outputFile, expected, M);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+void testFailedSortKeepsKeys() {
+  const std::string dir = "data/io_context_test";
+  std::vector<int64_t> data = generateRandomInt64Data(40000);
+  std::vector<int64_t> expected = data;
+  std::sort(expected.begin(), expected.end());
+  const size_t M = 64 * 1024;
+
+  // A merge that fails in place has lost keys, so it must not return.
+  MergeSort sorter;
+  sorter.setTempDirectory(dir + "/failing");
+  sorter.setBlockDevice(std::make_shared<FailingDevice>(2));
+  std::vector<int64_t> inPlace = data;
+  bool threw = false;
+  try {
+    sorter.externalSort(inPlace, M, 4);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // With a separate output the input is intact and sorted in memory.
+  sorter.setBlockDevice(std::make_shared<FailingDevice>(2));
+  std::vector<int64_t> output(data.size());
+  sorter.sortView(data.data(), data.size(), output.data(), M, 4);
+  assert(output == expected);
+
+  // The same holds once QuickSort has written some sorted partitions.
+  QuickSort quick;
+  quick.setBlockDevice(std::make_shared<FailingDevice>(2));
+  inPlace = data;
+  threw = false;
+  try {
+    quick.sort(inPlace, M, 8);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  quick.setBlockDevice(std::make_shared<FailingDevice>(2));
+  std::fill(output.begin(), output.end(), 0);
+  quick.sortView(data.data(), data.size(), output.data(), M, 8);
+  assert(output == expected);
+
+  // The failed passes leave their partition files behind.
+  for (const auto& entry :
+       std::filesystem::directory_iterator("data/quicksort_temp")) {
+    std::filesystem::remove(entry.path());
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+template <typename Sorter>
+void checkShortReadThrows(Sorter& sorter, const std::string& inputFile,
+                          const std::string& outputFile, size_t M) {
+  sorter.setBlockDevice(std::make_shared<ShortReadDevice>());
+  bool threw = false;
+  try {
+    sorter.sortFile(inputFile, outputFile, M, 8);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void testShortReadsThrow() {
+  const std::string dir = "data/io_context_test";
+  const std::string inputFile = dir + "/short_input.bin";
+  const std::string outputFile = dir + "/short_output.bin";
+  std::filesystem::create_directories(dir);
+  writeInt64ToFile(inputFile, generateRandomInt64Data(40000));
+  const size_t M = 64 * 1024;
+
+  // The partitions fit in memory and are read back in one request; a
+  // short read must not leave zeros in the output.
+  QuickSort quickSort;
+  checkShortReadThrows(quickSort, inputFile, outputFile, M);
+  RadixSort radixSort;
+  checkShortReadThrows(radixSort, inputFile, outputFile, M);
+
+  // The failed passes leave their partition and bucket files behind.
+  for (const char* temp : {"data/quicksort_temp", "data/radixsort_temp"}) {
+    for (const auto& entry : std::filesystem::directory_iterator(temp)) {
+      std::filesystem::remove(entry.path());
+    }
+  }
+  std::filesystem::remove_all(dir);
+}
+
+void testPerSorterStats() {
+  const std::string dir = "data/io_context_test";
+  std::filesystem::create_directories(dir);
+  const std::string inputFile = dir + "/input.bin";
+  std::vector<int64_t> data = generateRandomInt64Data(40000);
+  writeInt64DataToFile(data, inputFile);
+  const size_t M = 32 * 1024;
+
+  MergeSort reference;
+  reference.setTempDirectory(dir + "/reference");
+  reference.sortFile(inputFile, dir + "/reference.bin", M, 4);
+  IoStats alone = reference.ioStats();
+
+  // Concurrent sorters share the legacy counters but not their statistics.
+  std::vector<MergeSort> sorters(3);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sorters.size(); i++) {
+    std::string name = dir + "/sorter_" + std::to_string(i);
+    sorters[i].setTempDirectory(name);
+    threads.emplace_back([&sorters, &inputFile, name, i, M] {
+      sorters[i].sortFile(inputFile, name + ".bin", M, 4);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& sorter : sorters) {
+    assert(sameStats(sorter.ioStats(), alone));
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+int main() {
+  Timer timer;
+  timer.start();
+  testAccounting();
+  testConcurrentAccounting();
+  testQueue(IoQueueKind::Auto);
+  testQueue(IoQueueKind::Uring);
+  testQueue(IoQueueKind::ThreadPool);
+  testAlignedBufferPool();
+  testPoolWithinBudget();
+  testDirectDevice();
+  testPartitionWriterSet();
+  testMappedFile();
+  testSortView();
+  testEnginesUseDevice();
+  testFailedSortKeepsKeys();
+  testShortReadsThrow();
+  testPerSorterStats();
+  timer.stop();
+  std::cout << "All IoContext tests passed!" << std::endl;
+  std::cout << "IoContext tests executed in: " << timer.elapsed()
+            << " seconds." << std::endl;
+  return 0;
+}
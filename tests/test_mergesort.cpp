@@ -1,8 +1,16 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <filesystem>
 #include <iostream>
 #include <vector>
 
+#include "algorithms/loser_tree.h"
 #include "algorithms/mergesort.h"
+#include "utils/file_handler.h"
+#include "utils/test_generator.h"
 #include "utils/timer.h"
 
 void testMergeSort() {
@@ -28,13 +36,189 @@ void testMergeSort() {
   sorter.sort(arr5);
   assert(arr5 == std::vector<int>({1, 1, 2, 3, 4, 5, 5, 6, 9}));
 
+  std::vector<int> arr6 = generateRandomData(10007);
+  std::vector<int> expected6 = arr6;
+  sorter.sort(arr6);
+  std::sort(expected6.begin(), expected6.end());
+  assert(arr6 == expected6);
+
+  std::vector<int64_t> arr7 = generateRandomInt64Data(5000);
+  for (size_t i = 0; i < arr7.size(); i += 3) {
+    arr7[i] = -arr7[i];
+  }
+  std::vector<int64_t> expected7 = arr7;
+  sorter.sort(arr7);
+  std::sort(expected7.begin(), expected7.end());
+  assert(arr7 == expected7);
+
   std::cout << "All MergeSort tests passed!" << std::endl;
 }
 
+void testMergePlan() {
+  std::vector<size_t> sizes = {100, 1, 2, 50, 3, 7, 9, 1000, 4, 5};
+  std::vector<MergeStep> plan = MergeSort::planMerges(sizes, 4);
+
+  // (10 - 1) mod 3 == 0, so every merge is a full 4-way merge.
+  assert(plan.size() == 3);
+  for (const auto& step : plan) {
+    assert(step.inputs.size() == 4);
+  }
+  assert(plan[0].elements == 1 + 2 + 3 + 4);
+  assert(plan.back().elements == 1181);
+
+  sizes.push_back(6);
+  plan = MergeSort::planMerges(sizes, 4);
+  assert(plan.size() == 4);
+  assert(plan[0].inputs.size() == 2);
+  assert(plan[0].elements == 1 + 2);
+  assert(plan.back().output == sizes.size() + plan.size() - 1);
+  assert(plan.back().elements == 1187);
+
+  assert(MergeSort::planMerges({42}, 4).empty());
+
+  std::cout << "All merge plan tests passed!" << std::endl;
+}
+
+void testExplain() {
+  MergeSort ms;
+  std::vector<int64_t> data = generateRandomInt64Data(100000);
+
+  // 20 runs of 5000 keys (half of M) merged 3 at a time: three merge
+  // levels.
+  SortExplanation predicted = ms.explain(data.size(), 80000, 3);
+  assert(predicted.runs == 20);
+  assert(predicted.passes == 3);
+  assert(predicted.peakTempBytes >= data.size() * sizeof(int64_t));
+
+  // Runs, their radix scratch and the merge buffers all fit in M.
+  assert(predicted.peakBufferBytes <= 80000);
+  MergeSort threaded;
+  threaded.setThreadCount(4);
+  assert(threaded.explain(data.size(), 80000, 3).peakBufferBytes <= 80000);
+
+  ms.externalSort(data, 80000, 3);
+  assert(std::is_sorted(data.begin(), data.end()));
+  assert(predicted.diskReads == getDiskReadCount());
+  assert(predicted.diskWrites == getDiskWriteCount());
+
+  std::cout << "All explain tests passed!" << std::endl;
+}
+
+void testMergeSortFile() {
+  MergeSort sorter;
+  std::string inputFile = "data/test_mergesort_input.bin";
+  std::string outputFile = "data/test_mergesort_output.bin";
+
+  std::vector<int64_t> data = generateRandomInt64Data(20000);
+  writeInt64DataToFile(data, inputFile);
+
+  sorter.sortFile(inputFile, outputFile, 8000, 4);
+
+  std::vector<int64_t> sorted = readInt64DataFromFile(outputFile);
+  std::sort(data.begin(), data.end());
+  assert(sorted == data);
+
+  std::vector<int64_t> ascending(20000);
+  for (size_t i = 0; i < ascending.size(); i++) {
+    ascending[i] = static_cast<int64_t>(i);
+  }
+  std::vector<int64_t> shuffled = generateRandomInt64Data(20000);
+
+  sorter.setRunGeneration(RunGeneration::ReplacementSelection);
+  for (const auto& input : {ascending, shuffled}) {
+    writeInt64DataToFile(input, inputFile);
+    sorter.sortFile(inputFile, outputFile, 8000, 4);
+    std::vector<int64_t> expected = input;
+    std::sort(expected.begin(), expected.end());
+    assert(readInt64DataFromFile(outputFile) == expected);
+  }
+
+  std::vector<int64_t> inMemory = shuffled;
+  sorter.externalSort(inMemory, 8000, 4);
+  std::sort(shuffled.begin(), shuffled.end());
+  assert(inMemory == shuffled);
+  sorter.setRunGeneration(RunGeneration::FixedSize);
+
+  std::vector<int64_t> large = generateRandomInt64Data(50000);
+  writeInt64DataToFile(large, inputFile);
+  sorter.setThreadCount(4);
+  sorter.sortFile(inputFile, outputFile, 80000, 8);
+  std::sort(large.begin(), large.end());
+  assert(readInt64DataFromFile(outputFile) == large);
+
+  for (size_t i = 0; i < large.size(); i++) {
+    large[i] = static_cast<int64_t>(i % 3);
+  }
+  writeInt64DataToFile(large, inputFile);
+  sorter.sortFile(inputFile, outputFile, 80000, 8);
+  std::vector<int64_t> parallelInMemory = large;
+  sorter.externalSort(parallelInMemory, 80000, 8);
+  sorter.setThreadCount(1);
+  std::sort(large.begin(), large.end());
+  assert(readInt64DataFromFile(outputFile) == large);
+  assert(parallelInMemory == large);
+
+  std::vector<int64_t> streamed;
+  writeInt64DataToFile(shuffled, inputFile);
+  sorter.sortFileTo(
+      inputFile,
+      [&streamed](const int64_t* data, size_t count) {
+        streamed.insert(streamed.end(), data, data + count);
+      },
+      8000, 4);
+  assert(streamed == shuffled);
+
+  int fd = ::open(outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  sorter.sortFileTo(inputFile, MergeSort::descriptorSink(fd), 8000, 4);
+  ::close(fd);
+  assert(readInt64DataFromFile(outputFile) == shuffled);
+
+  writeInt64DataToFile({}, inputFile);
+  sorter.sortFile(inputFile, outputFile, 8000, 4);
+  assert(readInt64DataFromFile(outputFile).empty());
+
+  std::filesystem::remove(inputFile);
+  std::filesystem::remove(outputFile);
+
+  std::cout << "All MergeSort file tests passed!" << std::endl;
+}
+
+void testMultiwayMerge() {
+  for (size_t k : {1, 2, 3, 5, 64}) {
+    std::vector<std::vector<int64_t>> runs(k);
+    std::vector<int64_t> expected;
+    for (size_t i = 0; i < k; i++) {
+      if (i % 4 != 3) {
+        runs[i] = generateRandomInt64Data(100 + i * 7);
+        std::sort(runs[i].begin(), runs[i].end());
+      }
+      expected.insert(expected.end(), runs[i].begin(), runs[i].end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<std::pair<const int64_t*, const int64_t*>> ranges;
+    for (const auto& run : runs) {
+      ranges.push_back({run.data(), run.data() + run.size()});
+    }
+
+    std::vector<int64_t> merged(expected.size());
+    int64_t* end = multiwayMerge(ranges, merged.data());
+    assert(end == merged.data() + merged.size());
+    assert(merged == expected);
+  }
+
+  std::cout << "All loser tree tests passed!" << std::endl;
+}
+
 int main() {
   Timer timer;
   timer.start();
   testMergeSort();
+  testMultiwayMerge();
+  testMergePlan();
+  testMergeSortFile();
+  testExplain();
   timer.stop();
   std::cout << "MergeSort tests executed in: " << timer.elapsed() << " seconds."
             << std::endl;
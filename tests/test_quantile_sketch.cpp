@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "utils/quantile_sketch.h"
+#include "utils/test_generator.h"
+#include "utils/timer.h"
+
+// Checks that every splitter's true rank is within the sketch error bound
+// of its target rank.
+void checkSplitters(const QuantileSketch& sketch, std::vector<int64_t> keys,
+                    size_t parts, double tolerance) {
+  std::sort(keys.begin(), keys.end());
+  std::vector<int64_t> splitters = sketch.splitters(parts);
+  assert(splitters.size() == parts - 1);
+  assert(std::is_sorted(splitters.begin(), splitters.end()));
+
+  for (size_t i = 0; i < splitters.size(); i++) {
+    double target = static_cast<double>(keys.size()) * (i + 1) / parts;
+    auto range = std::equal_range(keys.begin(), keys.end(), splitters[i]);
+    double low = static_cast<double>(range.first - keys.begin());
+    double high = static_cast<double>(range.second - keys.begin());
+    double slack = tolerance * keys.size();
+    assert(low - slack <= target && target <= high + slack);
+  }
+}
+
+void testQuantileSketch() {
+  QuantileSketch small;
+  std::vector<int64_t> keys = {5, 1, 4, 2, 3};
+  small.update(keys.data(), keys.size());
+  assert(small.count() == 5);
+  assert(small.min() == 1 && small.max() == 5);
+  assert(small.rank(3) == 2);
+  assert(small.quantile(0.5) == 3);
+
+  std::vector<int64_t> data = generateRandomInt64Data(200000);
+  QuantileSketch sketch;
+  sketch.update(data.data(), data.size());
+  assert(sketch.count() == data.size());
+  assert(sketch.retained() < data.size() / 20);
+  double error = QuantileSketch::normalizedRankError(QuantileSketch::DEFAULT_K);
+  checkSplitters(sketch, data, 16, error);
+
+  // Halves sketched separately and merged.
+  QuantileSketch left;
+  QuantileSketch right;
+  left.update(data.data(), data.size() / 2);
+  right.update(data.data() + data.size() / 2, data.size() - data.size() / 2);
+  left.merge(right);
+  assert(left.count() == data.size());
+  checkSplitters(left, data, 16, 2 * error);
+
+  // A periodic pattern that strided sampling would alias with.
+  std::vector<int64_t> periodic(100000);
+  for (size_t i = 0; i < periodic.size(); i++) {
+    periodic[i] = static_cast<int64_t>(i % 100) * 1000 + (i % 7);
+  }
+  QuantileSketch sampled(QuantileSketch::DEFAULT_K, 10);
+  sampled.update(periodic.data(), periodic.size());
+  assert(sampled.count() == periodic.size());
+  checkSplitters(sampled, periodic, 8, 0.05);
+
+  std::cout << "All QuantileSketch tests passed!" << std::endl;
+}
+
+int main() {
+  Timer timer;
+  timer.start();
+  testQuantileSketch();
+  timer.stop();
+  std::cout << "QuantileSketch tests executed in: " << timer.elapsed()
+            << " seconds." << std::endl;
+  return 0;
+}
@@ -1,9 +1,13 @@
 #include <algorithm>
 #include <cassert>
+#include <filesystem>
 #include <iostream>
+#include <limits>
 #include <vector>
 
 #include "algorithms/quicksort.h"
+#include "algorithms/splitter_tree.h"
+#include "utils/file_handler.h"
 #include "utils/test_generator.h"
 #include "utils/timer.h"
 
@@ -49,8 +53,126 @@ void testQuickSort() {
             << " seconds.\n";
 }
 
+void testQuickSortFile() {
+  QuickSort qs;
+  std::string inputFile = "data/test_quicksort_input.bin";
+  std::string outputFile = "data/test_quicksort_output.bin";
+
+  std::vector<int64_t> data = generateRandomInt64Data(20000);
+  writeInt64DataToFile(data, inputFile);
+  qs.sortFile(inputFile, outputFile, 8000, 8);
+  std::sort(data.begin(), data.end());
+  assert(readInt64DataFromFile(outputFile) == data);
+
+  std::vector<int64_t> duplicates(20000, 7);
+  for (size_t i = 0; i < duplicates.size(); i += 100) {
+    duplicates[i] = static_cast<int64_t>(i);
+  }
+  writeInt64DataToFile(duplicates, inputFile);
+  qs.sortFile(inputFile, outputFile, 8000, 8);
+  std::sort(duplicates.begin(), duplicates.end());
+  assert(readInt64DataFromFile(outputFile) == duplicates);
+
+  // Few distinct keys with one dominant value: equality buckets take the
+  // heavy keys out of the recursion.
+  std::vector<int64_t> skewed = generateRandomInt64Data(40000);
+  for (size_t i = 0; i < skewed.size(); i++) {
+    skewed[i] = i % 4 == 0 ? static_cast<int64_t>(i % 12) : -3;
+  }
+  writeInt64DataToFile(skewed, inputFile);
+  qs.sortFile(inputFile, outputFile, 8000, 8);
+  std::sort(skewed.begin(), skewed.end());
+  assert(readInt64DataFromFile(outputFile) == skewed);
+
+  QuickSort parallel;
+  parallel.setThreadCount(4);
+  data = generateRandomInt64Data(50000);
+  writeInt64DataToFile(data, inputFile);
+  parallel.sortFile(inputFile, outputFile, 40000, 8);
+  std::sort(data.begin(), data.end());
+  assert(readInt64DataFromFile(outputFile) == data);
+
+  // The output may replace the input, on disk or in memory.
+  for (size_t n : {size_t(20000), size_t(500), size_t(0)}) {
+    data = generateRandomInt64Data(n);
+    writeInt64DataToFile(data, inputFile);
+    parallel.sortFile(inputFile, inputFile, 40000, 8);
+    std::sort(data.begin(), data.end());
+    assert(readInt64DataFromFile(inputFile) == data);
+  }
+
+  // Read blocks of over 8192 elements take the parallel classification.
+  data = generateRandomInt64Data(300000);
+  writeInt64DataToFile(data, inputFile);
+  parallel.sortFile(inputFile, outputFile, 800000, 4);
+  std::sort(data.begin(), data.end());
+  assert(readInt64DataFromFile(outputFile) == data);
+
+  std::vector<int64_t> mixed = generateRandomInt64Data(50000);
+  for (size_t i = 0; i < mixed.size(); i += 2) {
+    mixed[i] = static_cast<int64_t>(i % 5);
+  }
+  std::vector<int64_t> expected = mixed;
+  parallel.sort(mixed, 40000, 8);
+  std::sort(expected.begin(), expected.end());
+  assert(mixed == expected);
+
+  std::filesystem::remove(inputFile);
+  std::filesystem::remove(outputFile);
+  std::cout << "QuickSort file tests passed!\n";
+}
+
+void testSplitterTree() {
+  std::vector<int64_t> keys = generateRandomInt64Data(1000);
+  keys.push_back(std::numeric_limits<int64_t>::min());
+  keys.push_back(std::numeric_limits<int64_t>::max());
+
+  for (size_t count = 0; count <= 20; count++) {
+    std::vector<int64_t> pivots(keys.begin(), keys.begin() + count);
+    std::sort(pivots.begin(), pivots.end());
+    pivots.erase(std::unique(pivots.begin(), pivots.end()), pivots.end());
+
+    SplitterTree<int64_t> tree(pivots);
+    std::vector<uint32_t> buckets(keys.size());
+    tree.classify(keys.data(), keys.size(), buckets.data());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      size_t expected =
+          std::upper_bound(pivots.begin(), pivots.end(), keys[i]) -
+          pivots.begin();
+      assert(buckets[i] == expected);
+      assert(tree.find(keys[i]) == expected);
+    }
+  }
+  std::cout << "SplitterTree tests passed!\n";
+}
+
+void testExplain() {
+  QuickSort qs;
+  std::vector<int64_t> data = generateRandomInt64Data(60000);
+
+  SortExplanation predicted = qs.explain(data.size(), 16000, 8);
+  assert(predicted.runs == 8);
+  assert(predicted.passes >= 2);
+
+  qs.sort(data, 16000, 8);
+  assert(std::is_sorted(data.begin(), data.end()));
+
+  // Sketch pivots split less evenly than the prediction assumes.
+  auto close = [](size_t expected, size_t measured) {
+    return expected * 4 >= measured * 3 && expected * 4 <= measured * 5;
+  };
+  assert(close(predicted.diskReads, getDiskReadCount()));
+  assert(close(predicted.diskWrites, getDiskWriteCount()));
+
+  std::cout << "All explain tests passed!" << std::endl;
+}
+
 int main() {
   testQuickSort();
+  testQuickSortFile();
+  testSplitterTree();
+  testExplain();
   std::cout << "All QuickSort tests passed!" << std::endl;
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "algorithms/lsd_radix_sort.h"
+#include "algorithms/radixsort.h"
+#include "utils/file_handler.h"
+#include "utils/test_generator.h"
+#include "utils/timer.h"
+
+void testLsdRadixSort() {
+  std::vector<int64_t> scratch;
+
+  std::vector<int64_t> data1 = generateRandomInt64Data(100000);
+  std::vector<int64_t> expected1 = data1;
+  sortKeys(data1.data(), data1.size(), scratch);
+  std::sort(expected1.begin(), expected1.end());
+  assert(data1 == expected1);
+
+  std::vector<int64_t> data2 = {0,
+                                -1,
+                                5,
+                                std::numeric_limits<int64_t>::min(),
+                                std::numeric_limits<int64_t>::max(),
+                                -42,
+                                42,
+                                0};
+  std::vector<int64_t> expected2 = data2;
+  lsdRadixSort(data2.data(), data2.size(), scratch.data());
+  std::sort(expected2.begin(), expected2.end());
+  assert(data2 == expected2);
+
+  std::vector<int64_t> data3(10000, 7);
+  sortKeys(data3.data(), data3.size(), scratch);
+  assert(data3 == std::vector<int64_t>(10000, 7));
+
+  std::vector<int> data4 = generateRandomData(50000);
+  for (size_t i = 0; i < data4.size(); i += 2) {
+    data4[i] = -data4[i];
+  }
+  std::vector<int> expected4 = data4;
+  std::vector<int> intScratch;
+  sortKeys(data4.data(), data4.size(), intScratch);
+  std::sort(expected4.begin(), expected4.end());
+  assert(data4 == expected4);
+
+  std::cout << "All LSD radix sort tests passed!" << std::endl;
+}
+
+void testRadixSortEngine() {
+  RadixSort rs;
+  std::string inputFile = "data/test_radixsort_input.bin";
+  std::string outputFile = "data/test_radixsort_output.bin";
+  std::filesystem::create_directories("data");
+
+  std::vector<int64_t> data = generateRandomInt64Data(30000);
+  for (size_t i = 0; i < data.size(); i += 3) {
+    data[i] = -data[i];
+  }
+  writeInt64DataToFile(data, inputFile);
+  rs.sortFile(inputFile, outputFile, 16000, 8);
+  std::sort(data.begin(), data.end());
+  assert(readInt64DataFromFile(outputFile) == data);
+
+  // Keys clustered in a narrow range with outliers beyond the sampled one.
+  std::vector<int64_t> clustered(30000);
+  for (size_t i = 0; i < clustered.size(); i++) {
+    clustered[i] = 1000 + static_cast<int64_t>(i % 37);
+  }
+  clustered[123] = std::numeric_limits<int64_t>::min();
+  clustered[456] = std::numeric_limits<int64_t>::max();
+  writeInt64DataToFile(clustered, inputFile);
+  rs.sortFile(inputFile, outputFile, 16000, 4);
+  std::sort(clustered.begin(), clustered.end());
+  assert(readInt64DataFromFile(outputFile) == clustered);
+
+  // The output may replace the input, on disk or in memory.
+  for (size_t n : {size_t(30000), size_t(500), size_t(0)}) {
+    data = generateRandomInt64Data(n);
+    writeInt64DataToFile(data, inputFile);
+    rs.sortFile(inputFile, inputFile, 16000, 8);
+    std::sort(data.begin(), data.end());
+    assert(readInt64DataFromFile(inputFile) == data);
+  }
+
+  std::vector<int64_t> arr = generateRandomInt64Data(20000);
+  std::vector<int64_t> expected = arr;
+  rs.sort(arr, 16000, 16);
+  std::sort(expected.begin(), expected.end());
+  assert(arr == expected);
+
+  std::filesystem::remove(inputFile);
+  std::filesystem::remove(outputFile);
+  std::cout << "All RadixSort engine tests passed!" << std::endl;
+}
+
+void testExplain() {
+  RadixSort rs;
+
+  // Full-width keys: every bucket covers an equal share of the key range.
+  std::mt19937_64 rng(60000);
+  std::vector<int64_t> data(60000);
+  for (auto& key : data) {
+    key = static_cast<int64_t>(rng());
+  }
+
+  SortExplanation predicted = rs.explain(data.size(), 16000, 8);
+  assert(predicted.runs == 8);
+  assert(predicted.passes == 2);
+
+  rs.sort(data, 16000, 8);
+  assert(std::is_sorted(data.begin(), data.end()));
+
+  // Random bucket sizes differ a little from the even split.
+  auto close = [](size_t expected, size_t measured) {
+    return expected * 10 >= measured * 9 && expected * 10 <= measured * 11;
+  };
+  assert(close(predicted.diskReads, getDiskReadCount()));
+  assert(close(predicted.diskWrites, getDiskWriteCount()));
+
+  std::cout << "All explain tests passed!" << std::endl;
+}
+
+int main() {
+  Timer timer;
+  timer.start();
+  testLsdRadixSort();
+  testRadixSortEngine();
+  testExplain();
+  timer.stop();
+  std::cout << "RadixSort tests executed in: " << timer.elapsed()
+            << " seconds." << std::endl;
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+
+#include "algorithms/quicksort.h"
+#include "algorithms/radixsort.h"
+#include "utils/sort_parameters.h"
+#include "utils/sort_planner.h"
+#include "utils/timer.h"
+
+void testPlanShape() {
+  CostModel model = CostModel::defaults();
+  const size_t M = 8 * MB;
+  const SortEngine engines[] = {SortEngine::MergeSort, SortEngine::QuickSort,
+                                SortEngine::RadixSort};
+
+  for (SortEngine engine : engines) {
+    size_t previousPasses = 0;
+    for (size_t N : {size_t(1) << 16, size_t(1) << 22, size_t(1) << 26,
+                     size_t(1) << 30}) {
+      SortPlan plan = planSort(engine, N, M, model);
+      assert(plan.arity >= 2 && plan.arity <= MAX_PLAN_ARITY);
+      assert(plan.passes >= previousPasses);
+      assert(plan.seconds() > 0);
+      previousPasses = plan.passes;
+
+      if (N * sizeof(int64_t) >= M) {
+        assert(plan.bufferElements >= INTS_PER_BLOCK);
+      }
+      if (engine == SortEngine::RadixSort) {
+        assert((plan.arity & (plan.arity - 1)) == 0);
+      }
+      for (size_t a : {size_t(2), size_t(16), size_t(256)}) {
+        if (engine == SortEngine::RadixSort || a > plan.arity) continue;
+        assert(evaluatePlan(engine, N, M, a, model).seconds() >=
+               plan.seconds());
+      }
+    }
+  }
+
+  // Fits in memory: the distribution engines sort without any pass.
+  SortPlan small = planSort(SortEngine::QuickSort, 1000, M, model);
+  assert(small.passes == 0 && small.ioSeconds == 0);
+}
+
+void testPlanMatchesExplain() {
+  CostModel model = CostModel::defaults();
+  const size_t M = 8 * MB;
+  const size_t a = 16;
+  const size_t share = 200000;
+  const size_t N = a * share;
+
+  // One split pass into partitions that fit in memory: explain() writes
+  // each partition in buffers of the size the planner prices.
+  for (size_t threads : {size_t(1), size_t(4)}) {
+    QuickSort quickSort;
+    quickSort.setThreadCount(threads);
+    SortPlan plan =
+        evaluatePlan(SortEngine::QuickSort, N, M, a, model, threads);
+    assert(plan.bufferElements == distributionBufferElements(M, a, threads));
+    size_t writes = a * ((share + plan.bufferElements - 1) /
+                         plan.bufferElements);
+    assert(quickSort.explain(N, M, a).diskWrites == writes);
+  }
+
+  RadixSort radixSort;
+  SortPlan plan = evaluatePlan(SortEngine::RadixSort, N, M, a, model, 4);
+  assert(plan.bufferElements == distributionBufferElements(M, a, 1));
+  size_t writes =
+      a * ((share + plan.bufferElements - 1) / plan.bufferElements);
+  assert(radixSort.explain(N, M, a).diskWrites == writes);
+}
+
+void testLatencyShiftsArity() {
+  const size_t N = size_t(1) << 28;
+  const size_t M = 16 * MB;
+
+  CostModel fast = CostModel::defaults();
+  fast.requestLatency = 1e-7;
+  CostModel slow = CostModel::defaults();
+  slow.requestLatency = 20e-3;
+
+  // Expensive requests favour fewer, larger buffers.
+  for (SortEngine engine : {SortEngine::MergeSort, SortEngine::QuickSort}) {
+    SortPlan cheap = planSort(engine, N, M, fast);
+    SortPlan seeky = planSort(engine, N, M, slow);
+    assert(seeky.bufferElements >= cheap.bufferElements);
+    assert(seeky.arity <= cheap.arity);
+  }
+}
+
+void testCalibrationCache() {
+  const std::string dir = "data/sort_planner_test";
+  const std::string path = dir + "/cost_model.txt";
+  std::filesystem::remove_all(dir);
+
+  CostModel missing;
+  assert(!CostModel::load(path, missing));
+
+  CostModel measured = CostModel::forMachine(path);
+  assert(std::filesystem::exists(path));
+  assert(measured.readBandwidth > 0 && measured.writeBandwidth > 0);
+  assert(measured.requestLatency > 0 && measured.sortCost > 0);
+  assert(measured.mergeCost > 0 && measured.classifyCost > 0);
+  assert(measured.scatterCost > 0);
+
+  CostModel cached;
+  assert(CostModel::load(path, cached));
+  assert(cached.readBandwidth / measured.readBandwidth > 0.999 &&
+         cached.readBandwidth / measured.readBandwidth < 1.001);
+  assert(cached.scatterCost / measured.scatterCost > 0.999 &&
+         cached.scatterCost / measured.scatterCost < 1.001);
+
+  std::filesystem::remove_all(dir);
+}
+
+int main() {
+  Timer timer;
+  timer.start();
+  testPlanShape();
+  testPlanMatchesExplain();
+  testLatencyShiftsArity();
+  testCalibrationCache();
+  timer.stop();
+  std::cout << "All SortPlanner tests passed!" << std::endl;
+  std::cout << "SortPlanner tests executed in: " << timer.elapsed()
+            << " seconds." << std::endl;
+  return 0;
+}